@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "strmap.h"
+#include "template_bench.h"
 
 typedef std::chrono::high_resolution_clock Clock;
 
@@ -24,14 +25,31 @@ void fisher_yates_shuffle(char *s) {
 
 using namespace std;
 
-// sm_foreach callback
+// sm_foreach callback, ctx - map options
 void check_hash(SM_ENTRY item, void *ctx) {
-  if (poly_hashs(item.key) != item.hash) {
+  SM_OPTIONS *opts = (SM_OPTIONS *)ctx;
+  size_t hash =
+      opts->hash ? opts->hash(item.key, item.len) : poly_hashs(item.key);
+
+  // SM_COMPACT keeps low 32 bits
+  if (opts->flags & SM_COMPACT) {
+    hash = (unsigned int)hash;
+  }
+  if (hash != item.hash) {
     cout << "Hash error: " << item.hash << '\n';
   }
 }
 
-int main() {
+// sm_memory_usage breakdown
+void print_memory(const STRMAP *ht) {
+  SM_MEMORY usage;
+
+  sm_memory_usage(ht, &usage);
+  cout << "Memory: " << usage.total << " bytes, table " << usage.table
+       << ", keys " << usage.keys << ", per key " << usage.per_key << '\n';
+}
+
+int main(int argc, char **argv) {
   string str = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
   string xstr =
       "ZbcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -53,6 +71,7 @@ int main() {
 
   STRMAP *nht;
   STRMAP *ht;
+  SM_OPTIONS opts = options(argc, argv, 1);
 
   auto t1 = Clock::now();
   for (int i = 0; i < 3700000; i++) {
@@ -80,14 +99,33 @@ int main() {
   }
   t2 = Clock::now();
   elapsed = t2 - t1;
-  cout << "Hashing perf: " << elapsed.count() << '\n';
+  cout << "Hashing perf poly_hashs: " << elapsed.count() << '\n';
+
+  // built-in SM_OPTIONS hash functions
+  static const struct {
+    const char *name;
+    SM_HASH hash;
+  } HASHES[] = {{"poly_hashn", poly_hashn},
+                {"sm_hash_wy", sm_hash_wy},
+                {"sm_hash_crc32c", sm_hash_crc32c}};
+
+  for (size_t j = 0; j < sizeof(HASHES) / sizeof(HASHES[0]); j++) {
+    t1 = Clock::now();
+    for (int i = 0; i < 3700000; i++) {
+      HASHES[j].hash(keys[i].c_str(), keys[i].size());
+    }
+    t2 = Clock::now();
+    elapsed = t2 - t1;
+    cout << "Hashing perf " << HASHES[j].name << ": " << elapsed.count()
+         << '\n';
+  }
 
   cout << "*******************\n";
   cout << "*** strmap test ***\n";
   cout << "*******************\n";
 
   for (csize = 1000; csize <= 2048000; csize += csize) {
-    ht = sm_create(csize);
+    ht = sm_create_ex(csize, &opts);
     t1 = Clock::now();
     for (int i = 0; i < csize; i++) {
       if (sm_insert(ht, keys[i].c_str(), &val, &rentry) != SM_INSERTED) {
@@ -100,12 +138,84 @@ int main() {
     cout << "Insert " << sm_size(ht) << " keys: " << elapsed.count() << '\n';
     cout << "Mean: " << sm_probes_mean(ht) << '\n';
     cout << "Variance: " << sm_probes_var(ht) << '\n';
+    print_memory(ht);
 
     cout << "*******************\n";
     sm_free(ht);
   }
 
-  ht = sm_create(3700000);
+  // key copies: vector<string> plus borrowing map vs SM_OWN_KEYS arena
+  {
+    SM_OPTIONS own = opts;
+    own.flags |= SM_OWN_KEYS;
+
+    t1 = Clock::now();
+    vector<string> copies;
+    ht = sm_create_ex(3700000, &opts);
+    for (int i = 0; i < 3700000; i++) {
+      copies.push_back(keys[i]);
+      sm_insert(ht, copies.back().c_str(), &val, &rentry);
+    }
+    sm_free(ht);
+    copies.clear();
+    t2 = Clock::now();
+    elapsed = t2 - t1;
+    cout << "Copy keys to vector and insert, free: " << elapsed.count() << '\n';
+
+    t1 = Clock::now();
+    ht = sm_create_ex(3700000, &own);
+    for (int i = 0; i < 3700000; i++) {
+      sm_insert(ht, keys[i].c_str(), &val, &rentry);
+    }
+    sm_free(ht);
+    t2 = Clock::now();
+    elapsed = t2 - t1;
+    cout << "Insert owned keys, free: " << elapsed.count() << '\n';
+  }
+
+  // per request map: few keys, then sm_clear of a large table
+  {
+    SM_OPTIONS dirty = opts;
+    dirty.flags |= SM_DIRTY_LOG;
+    SM_OPTIONS *modes[] = {&opts, &dirty};
+
+    for (int m = 0; m < 2; m++) {
+      ht = sm_create_ex(100000, modes[m]);
+      t1 = Clock::now();
+      for (int r = 0; r < 10000; r++) {
+        for (int i = 0; i < 16; i++) {
+          sm_insert(ht, keys[r * 16 + i].c_str(), &val, &rentry);
+        }
+        sm_clear(ht);
+      }
+      t2 = Clock::now();
+      elapsed = t2 - t1;
+      cout << "Insert 16 keys and clear" << (m ? " SM_DIRTY_LOG: " : ": ")
+           << elapsed.count() << '\n';
+      sm_free(ht);
+    }
+  }
+
+  // single insert latency with growth from empty map
+  {
+    vector<double> lat(3700000);
+
+    ht = sm_create_ex(0, &opts);
+    for (int i = 0; i < 3700000; i++) {
+      t1 = Clock::now();
+      sm_insert(ht, keys[i].c_str(), &val, &rentry);
+      t2 = Clock::now();
+      elapsed = t2 - t1;
+      lat[i] = elapsed.count();
+    }
+    sm_free(ht);
+    sort(lat.begin(), lat.end());
+    cout << "Insert latency p99: " << lat[lat.size() * 99 / 100]
+         << " p99.99: " << lat[lat.size() * 9999 / 10000]
+         << " max: " << lat.back() << '\n';
+  }
+
+  ht = sm_create_ex(3700000, &opts);
   t1 = Clock::now();
   for (int i = 0; i < 3700000; i++) {
     if (sm_insert(ht, keys[i].c_str(), &val, &rentry) != SM_INSERTED) {
@@ -119,6 +229,7 @@ int main() {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (int i = 0; i < 3700000; i++) {
@@ -157,9 +268,10 @@ int main() {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
-  sm_foreach(ht, check_hash, 0);
+  sm_foreach(ht, check_hash, &opts);
   t2 = Clock::now();
   elapsed = t2 - t1;
   cout << "Foreach check_hash(): " << elapsed.count() << '\n';
@@ -230,6 +342,29 @@ int main() {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
+  cout << "Load factor: " << sm_load_factor(ht) << '\n';
+
+  nht = sm_create_from(ht, 5000000);
+  t1 = Clock::now();
+  sm_shrink_to_fit(nht);
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Shrink to fit: " << elapsed.count() << '\n';
+  cout << "Load factor: " << sm_load_factor(nht) << '\n';
+
+  t1 = Clock::now();
+  sm_foreach(nht, check_hash, &opts);
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Foreach shrunk: " << elapsed.count() << '\n';
+  sm_free(nht);
+
+  t1 = Clock::now();
+  sm_foreach(ht, check_hash, &opts);
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Foreach: " << elapsed.count() << '\n';
 
   t1 = Clock::now();
   for (int i = 0; i < 3000000; i++) {
@@ -244,6 +379,7 @@ int main() {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (int i = 0; i < 3700000; i++) {
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "strmap.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+using namespace std;
+
+// byte at a time poly_hashs
+__attribute__((noinline)) size_t poly_hash_ref(const char *key) {
+  size_t hash = 0;
+
+  while (*key) {
+    hash += (hash << 8) + (unsigned char)(*key);
+    ++key;
+  }
+
+  return hash;
+}
+
+size_t poly_hashs_n(const char *key, size_t len) {
+  (void)len;
+  return poly_hashs(key);
+}
+
+size_t poly_hash_ref_n(const char *key, size_t len) {
+  (void)len;
+  return poly_hash_ref(key);
+}
+
+// hash throughput across key lengths, e.g. ./hashes 64
+int main(int argc, char **argv) {
+  static const struct {
+    const char *name;
+    SM_HASH hash;
+  } HASHES[] = {{"poly_hash_ref", poly_hash_ref_n},
+                {"poly_hashs", poly_hashs_n},
+                {"poly_hashn", poly_hashn},
+                {"sm_hash_wy", sm_hash_wy},
+                {"sm_hash_crc32c", sm_hash_crc32c}};
+  static const size_t LENGTHS[] = {4, 8, 15, 16, 31, 32, 62, 128, 256, 1024};
+  // bytes hashed per length and function
+  size_t total = 64u << 20;
+  std::chrono::duration<double> elapsed;
+  size_t sum = 0;
+
+  if (argc > 1) {
+    total = strtoul(argv[1], 0, 10) << 20;
+  }
+
+  for (size_t l = 0; l < sizeof(LENGTHS) / sizeof(LENGTHS[0]); l++) {
+    size_t len = LENGTHS[l];
+    size_t n = total / len;
+    // keys 8 byte aligned as malloc'ed strings
+    size_t stride = (len + 8) & ~(size_t)7;
+    vector<size_t> buf((n * stride + 8) / sizeof(size_t));
+    vector<const char *> keys(n);
+    char *base = (char *)buf.data();
+
+    for (size_t i = 0, pos = 0; i < n; i++, pos += stride) {
+      for (size_t j = 0; j < len; j++) {
+        base[pos + j] = (char)('A' + (i * 31 + j * 7) % 58);
+      }
+      base[pos + len] = 0;
+      keys[i] = &base[pos];
+    }
+
+    cout << "Key length " << len << ", " << n << " keys\n";
+    for (size_t j = 0; j < sizeof(HASHES) / sizeof(HASHES[0]); j++) {
+      // best of 3 runs
+      double best = 0.0;
+      for (int r = 0; r < 3; r++) {
+        auto t1 = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+          sum += HASHES[j].hash(keys[i], len);
+        }
+        auto t2 = Clock::now();
+        elapsed = t2 - t1;
+        if (!r || elapsed.count() < best) {
+          best = elapsed.count();
+        }
+      }
+      cout << "  " << HASHES[j].name << ": " << best << " s, "
+           << (double)(n * len) / best / 1e9 << " GB/s\n";
+    }
+  }
+  cout << "Checksum: " << sum << '\n';
+}
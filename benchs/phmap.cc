@@ -4,8 +4,10 @@
 #include <iostream>
 #include <vector>
 
+#include "meminfo.h"
 #include "phmap.h"
 #include "strmap.h"
+#include "template_bench.h"
 
 typedef std::chrono::high_resolution_clock Clock;
 
@@ -23,13 +25,64 @@ void fisher_yates_shuffle(char *s) {
 
 using namespace std;
 
-// sm_foreach callback
+// sm_foreach callback, ctx - map options
 void check_hash(SM_ENTRY item, void *ctx) {
-  if (poly_hashs(item.key) != item.hash) {
+  SM_OPTIONS *opts = (SM_OPTIONS *)ctx;
+  size_t hash =
+      opts->hash ? opts->hash(item.key, item.len) : poly_hashs(item.key);
+
+  // SM_COMPACT keeps low 32 bits
+  if (opts->flags & SM_COMPACT) {
+    hash = (unsigned int)hash;
+  }
+  if (hash != item.hash) {
     cout << "Hash error: " << item.hash << '\n';
   }
 }
 
+// sm_memory_usage breakdown
+void print_memory(const STRMAP *ht) {
+  SM_MEMORY usage;
+
+  sm_memory_usage(ht, &usage);
+  cout << "Memory: " << usage.total << " bytes, table " << usage.table
+       << ", keys " << usage.keys << ", per key " << usage.per_key << '\n';
+}
+
+// SM_ALLOCATOR sampling process memory while map blocks are alive
+uint64_t peak_memory = 0;
+
+void sample_memory() {
+  uint64_t used = spp::GetProcessMemoryUsed();
+
+  if (used > peak_memory) {
+    peak_memory = used;
+  }
+}
+
+void *peak_alloc(void *, size_t size) {
+  void *ptr = malloc(size);
+  sample_memory();
+  return ptr;
+}
+
+void *peak_zalloc(void *, size_t size) {
+  void *ptr = calloc(1, size);
+  sample_memory();
+  return ptr;
+}
+
+void *peak_realloc(void *, void *ptr, size_t size) {
+  ptr = realloc(ptr, size);
+  sample_memory();
+  return ptr;
+}
+
+void peak_free(void *, void *ptr) {
+  sample_memory();
+  free(ptr);
+}
+
 int main(int argc, char **argv) {
   unsigned long MAP_SIZE = 1024;
   string str = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -56,6 +109,7 @@ int main(int argc, char **argv) {
   char *ptr;
   
   MAP_SIZE = strtoul(argv[1], &ptr, 10);
+  SM_OPTIONS opts = options(argc, argv, 1);
 
   auto t1 = Clock::now();
   for (unsigned long i = 0; i < MAP_SIZE; i++) {
@@ -89,10 +143,14 @@ int main(int argc, char **argv) {
   cout << "*** strmap test ***\n";
   cout << "*******************\n";
 
+  SM_ALLOCATOR peak = {peak_alloc, peak_zalloc, peak_realloc, peak_free, 0};
+  uint64_t base_memory = spp::GetProcessMemoryUsed();
+  opts.alloc = &peak;
+
 #ifdef RESERVE
-  ht = sm_create(MAP_SIZE);
+  ht = sm_create_ex(MAP_SIZE, &opts);
 #else  
-  ht = sm_create(0);
+  ht = sm_create_ex(0, &opts);
 #endif    
   if (!ht) {
       exit(-1);
@@ -108,10 +166,16 @@ int main(int argc, char **argv) {
   t2 = Clock::now();
   elapsed = t2 - t1;
   cout << "Insert: " << elapsed.count() << '\n';
+  sample_memory();
+  cout << "Memory MB: "
+       << (double)(spp::GetProcessMemoryUsed() - base_memory) / 1048576.0
+       << ", peak MB: " << (double)(peak_memory - base_memory) / 1048576.0
+       << '\n';
   cout << "Size: " << sm_size(ht) << '\n';
   cout << "Load factor: " << sm_load_factor(ht) << '\n';  
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (unsigned long i = 0; i < MAP_SIZE; i++) {
@@ -141,7 +205,7 @@ int main(int argc, char **argv) {
   cout << "Lookup not existing: " << elapsed.count() << '\n';
 
   t1 = Clock::now();
-  sm_foreach(ht, check_hash, 0);
+  sm_foreach(ht, check_hash, &opts);
   t2 = Clock::now();
   elapsed = t2 - t1;
   cout << "Foreach check_hash(): " << elapsed.count() << '\n';
@@ -225,6 +289,7 @@ int main(int argc, char **argv) {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (unsigned long i = 0; i < MAP_SIZE; i++) {
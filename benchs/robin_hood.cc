@@ -6,6 +6,7 @@
 
 #include "robin_hood.h"
 #include "strmap.h"
+#include "template_bench.h"
 
 typedef std::chrono::high_resolution_clock Clock;
 
@@ -23,13 +24,30 @@ void fisher_yates_shuffle(char *s) {
 
 using namespace std;
 
-// sm_foreach callback
+// sm_foreach callback, ctx - map options
 void check_hash(SM_ENTRY item, void *ctx) {
-  if (poly_hashs(item.key) != item.hash) {
+  SM_OPTIONS *opts = (SM_OPTIONS *)ctx;
+  size_t hash =
+      opts->hash ? opts->hash(item.key, item.len) : poly_hashs(item.key);
+
+  // SM_COMPACT keeps low 32 bits
+  if (opts->flags & SM_COMPACT) {
+    hash = (unsigned int)hash;
+  }
+  if (hash != item.hash) {
     cout << "Hash error: " << item.hash << '\n';
   }
 }
 
+// sm_memory_usage breakdown
+void print_memory(const STRMAP *ht) {
+  SM_MEMORY usage;
+
+  sm_memory_usage(ht, &usage);
+  cout << "Memory: " << usage.total << " bytes, table " << usage.table
+       << ", keys " << usage.keys << ", per key " << usage.per_key << '\n';
+}
+
 int main(int argc, char **argv) {
   unsigned long MAP_SIZE = 1024;
   string str = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -56,6 +74,7 @@ int main(int argc, char **argv) {
   char *ptr;
   
   MAP_SIZE = strtoul(argv[1], &ptr, 10);
+  SM_OPTIONS opts = options(argc, argv, 1);
 
   auto t1 = Clock::now();
   for (unsigned long i = 0; i < MAP_SIZE; i++) {
@@ -90,9 +109,9 @@ int main(int argc, char **argv) {
   cout << "*******************\n";
 
 #ifdef RESERVE
-  ht = sm_create(MAP_SIZE);
+  ht = sm_create_ex(MAP_SIZE, &opts);
 #else  
-  ht = sm_create(0);
+  ht = sm_create_ex(0, &opts);
 #endif    
   if (!ht) {
       exit(-1);
@@ -112,6 +131,7 @@ int main(int argc, char **argv) {
   cout << "Load factor: " << sm_load_factor(ht) << '\n';  
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (unsigned long i = 0; i < MAP_SIZE; i++) {
@@ -141,7 +161,7 @@ int main(int argc, char **argv) {
   cout << "Lookup not existing: " << elapsed.count() << '\n';
 
   t1 = Clock::now();
-  sm_foreach(ht, check_hash, 0);
+  sm_foreach(ht, check_hash, &opts);
   t2 = Clock::now();
   elapsed = t2 - t1;
   cout << "Foreach check_hash(): " << elapsed.count() << '\n';
@@ -225,6 +245,7 @@ int main(int argc, char **argv) {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (unsigned long i = 0; i < MAP_SIZE; i++) {
@@ -243,6 +264,8 @@ int main(int argc, char **argv) {
 
   sm_free(ht);
 
+  run_templates(opts, keys, xkeys);
+
   cout << "*************************************\n";
   cout << "*** robin_hood unordered_map test ***\n";
   cout << "*************************************\n";
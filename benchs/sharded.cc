@@ -0,0 +1,279 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lfmap.h"
+#include "phmap.h"
+#include "rcumap.h"
+#include "shardmap.h"
+#include "strmap.h"
+#include "template_bench.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+void fisher_yates_shuffle(char *s) {
+  size_t i, j, n = strlen(s);
+  char tmp;
+
+  for (i = n - 1; i > 0; --i) {
+    j = rand() % (i + 1);
+    tmp = s[j];
+    s[j] = s[i];
+    s[i] = tmp;
+  }
+}
+
+using namespace std;
+
+// run `work(from, to)` on `threads` slices of [0, n), seconds
+template <class Work> double parallel(unsigned threads, size_t n, Work work) {
+  vector<thread> pool;
+  auto t1 = Clock::now();
+
+  for (unsigned t = 0; t < threads; t++) {
+    pool.emplace_back(work, n * t / threads, n * (t + 1) / threads);
+  }
+  for (auto &th : pool) {
+    th.join();
+  }
+  chrono::duration<double> elapsed = Clock::now() - t1;
+  return elapsed.count();
+}
+
+// multi-threaded insert, lookup and remove: one STRMAP behind a global
+// mutex, sm_sharded_*, sm_rcu_* and SM_SEQLOCK (lookups only in
+// parallel), sm_lf_* (insert only) and phmap::parallel_flat_hash_map
+// with std::mutex
+int main(int argc, char **argv) {
+  string str = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  string xstr =
+      "ZbcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  size_t MAP_SIZE = 1000000;
+  unsigned threads = thread::hardware_concurrency();
+  vector<string> keys;
+  vector<string> xkeys;
+  int val = 1551;
+
+  if (argc > 1) {
+    MAP_SIZE = strtoul(argv[1], 0, 10);
+  }
+  if (argc > 2) {
+    threads = (unsigned)strtoul(argv[2], 0, 10);
+  }
+  threads = threads ? threads : 1;
+  SM_OPTIONS opts = options(argc, argv, 3);
+
+  for (size_t i = 0; i < MAP_SIZE; i++) {
+    fisher_yates_shuffle((char *)str.c_str());
+    keys.push_back(str);
+    fisher_yates_shuffle((char *)xstr.c_str());
+    xkeys.push_back(xstr);
+  }
+  cout << MAP_SIZE << " keys, " << threads << " threads\n";
+
+  cout << "*** strmap, global mutex ***\n";
+  {
+    STRMAP *ht = sm_create_ex(0, &opts);
+    mutex lock;
+
+    cout << "Insert: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        lock_guard<mutex> guard(lock);
+        sm_insert(ht, keys[i].c_str(), &val, 0);
+      }
+    }) << '\n';
+    cout << "Lookup existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        lock_guard<mutex> guard(lock);
+        if (sm_lookup(ht, keys[i].c_str(), 0) != SM_FOUND) {
+          cout << "Error: " << keys[i] << '\n';
+        }
+      }
+    }) << '\n';
+    cout << "Lookup not existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        lock_guard<mutex> guard(lock);
+        sm_lookup(ht, xkeys[i].c_str(), 0);
+      }
+    }) << '\n';
+    cout << "Remove: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        lock_guard<mutex> guard(lock);
+        sm_remove(ht, keys[i].c_str(), 0);
+      }
+    }) << '\n';
+    sm_free(ht);
+  }
+
+  cout << "*** sm_sharded ***\n";
+  {
+    SM_SHARDED *ht = sm_sharded_create(0, 4 * threads, &opts);
+    SM_MEMORY usage;
+
+    if (!ht) {
+      cout << "Error: options\n";
+      return 1;
+    }
+    cout << "Shards: " << sm_sharded_shards(ht) << '\n';
+    cout << "Insert: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        sm_sharded_insert(ht, keys[i].c_str(), &val, 0);
+      }
+    }) << '\n';
+    sm_sharded_memory_usage(ht, &usage);
+    cout << "Size: " << sm_sharded_size(ht) << ", memory " << usage.total
+         << ", per key " << usage.per_key << '\n';
+    cout << "Lookup existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        if (sm_sharded_lookup(ht, keys[i].c_str(), 0) != SM_FOUND) {
+          cout << "Error: " << keys[i] << '\n';
+        }
+      }
+    }) << '\n';
+    cout << "Lookup not existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        sm_sharded_lookup(ht, xkeys[i].c_str(), 0);
+      }
+    }) << '\n';
+    cout << "Remove: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        sm_sharded_remove(ht, keys[i].c_str(), 0);
+      }
+    }) << '\n';
+    sm_sharded_free(ht);
+  }
+
+  cout << "*** sm_rcu, single writer ***\n";
+  {
+    SM_RCU *ht = sm_rcu_create(0, threads, &opts);
+    atomic<unsigned> next(0);
+
+    if (!ht) {
+      cout << "Error: options\n";
+      return 1;
+    }
+    cout << "Insert: " << parallel(1, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        sm_rcu_insert(ht, keys[i].c_str(), &val, 0);
+      }
+    }) << '\n';
+    cout << "Lookup existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      unsigned reader = next++ % threads;
+      for (size_t i = from; i < to; i++) {
+        if (sm_rcu_lookup(ht, reader, keys[i].c_str(), 0) != SM_FOUND) {
+          cout << "Error: " << keys[i] << '\n';
+        }
+      }
+    }) << '\n';
+    cout << "Lookup not existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      unsigned reader = next++ % threads;
+      for (size_t i = from; i < to; i++) {
+        sm_rcu_lookup(ht, reader, xkeys[i].c_str(), 0);
+      }
+    }) << '\n';
+    cout << "Remove: " << parallel(1, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        sm_rcu_remove(ht, keys[i].c_str(), 0);
+      }
+    }) << '\n';
+    sm_rcu_free(ht);
+  }
+
+  cout << "*** strmap SM_SEQLOCK, single writer ***\n";
+  {
+    SM_OPTIONS seq = opts;
+    seq.flags |= SM_SEQLOCK;
+    STRMAP *ht = sm_create_ex(0, &seq);
+
+    if (ht) {
+      cout << "Insert: " << parallel(1, MAP_SIZE, [&](size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+          sm_insert(ht, keys[i].c_str(), &val, 0);
+        }
+      }) << '\n';
+      cout << "Lookup existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+          if (sm_lookup(ht, keys[i].c_str(), 0) != SM_FOUND) {
+            cout << "Error: " << keys[i] << '\n';
+          }
+        }
+      }) << '\n';
+      cout << "Lookup not existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+          sm_lookup(ht, xkeys[i].c_str(), 0);
+        }
+      }) << '\n';
+      cout << "Remove: " << parallel(1, MAP_SIZE, [&](size_t from, size_t to) {
+        for (size_t i = from; i < to; i++) {
+          sm_remove(ht, keys[i].c_str(), 0);
+        }
+      }) << '\n';
+      sm_free(ht);
+    }
+    else {
+      cout << "Skipped: options\n";
+    }
+  }
+
+  cout << "*** sm_lf, lock-free insert only ***\n";
+  {
+    SM_OPTIONS lf = {opts.flags & SM_POW2, opts.hash, 0, 0, 0};
+    SM_LFMAP *ht = sm_lf_create(0, &lf);
+
+    cout << "Insert: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        sm_lf_insert(ht, keys[i].c_str(), &val, 0);
+      }
+    }) << '\n';
+    cout << "Lookup existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        if (sm_lf_lookup(ht, keys[i].c_str(), 0) != SM_FOUND) {
+          cout << "Error: " << keys[i] << '\n';
+        }
+      }
+    }) << '\n';
+    cout << "Lookup not existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        sm_lf_lookup(ht, xkeys[i].c_str(), 0);
+      }
+    }) << '\n';
+    sm_lf_free(ht);
+  }
+
+  cout << "*** phmap::parallel_flat_hash_map ***\n";
+  {
+    phmap::parallel_flat_hash_map<
+        string, int, phmap::priv::hash_default_hash<string>,
+        phmap::priv::hash_default_eq<string>,
+        allocator<pair<const string, int>>, 4, mutex>
+        ht;
+
+    cout << "Insert: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        ht.insert({keys[i], val});
+      }
+    }) << '\n';
+    cout << "Lookup existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        if (!ht.contains(keys[i])) {
+          cout << "Error: " << keys[i] << '\n';
+        }
+      }
+    }) << '\n';
+    cout << "Lookup not existing: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        ht.contains(xkeys[i]);
+      }
+    }) << '\n';
+    cout << "Remove: " << parallel(threads, MAP_SIZE, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        ht.erase(keys[i]);
+      }
+    }) << '\n';
+  }
+}
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "strmap.h"
+#include "strset.h"
+#include "template_bench.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+
+using namespace std;
+
+// sm_memory_usage breakdown
+void print_memory(const STRMAP *ht) {
+  SM_MEMORY usage;
+
+  sm_memory_usage(ht, &usage);
+  cout << "Memory: " << usage.total << " bytes, table " << usage.table
+       << ", keys " << usage.keys << ", per key " << usage.per_key << '\n';
+}
+
+// map with data pointers against key only set, same options,
+// e.g. ./strset benchs/words.txt
+int main(int argc, char **argv) {
+  chrono::duration<double> elapsed;
+  vector<string> keys;
+  vector<string> xkeys;
+  int val = 1551;
+  size_t found;
+
+  if (argc < 2) {
+    cout << "Usage: strset words.txt [options]\n";
+    return 1;
+  }
+
+  // the key only set has no split, swiss, inline or compact layout
+  SM_OPTIONS opts = options(argc, argv, 2);
+  opts.flags &= ~(SM_SPLIT | SM_SWISS | SM_INLINE_KEYS | SM_COMPACT);
+  ifstream fwords(argv[1]);
+  string word;
+  while (getline(fwords, word)) {
+    keys.push_back(word);
+    // not existing keys, words never end with a tab
+    xkeys.push_back(word + '\t');
+  }
+  cout << "Load " << keys.size() << " words\n";
+
+  cout << "*** strmap ***\n";
+  STRMAP *ht = sm_create_ex(0, &opts);
+  auto t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    sm_insert(ht, keys[i].c_str(), &val, 0);
+  }
+  auto t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Insert " << sm_size(ht) << " keys: " << elapsed.count() << '\n';
+  print_memory(ht);
+
+  found = 0;
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    found += sm_lookup(ht, keys[i].c_str(), 0) == SM_FOUND;
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Lookup existing: " << elapsed.count() << ", found " << found
+       << '\n';
+
+  found = 0;
+  t1 = Clock::now();
+  for (size_t i = 0; i < xkeys.size(); i++) {
+    found += sm_lookup(ht, xkeys[i].c_str(), 0) == SM_FOUND;
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Lookup not existing: " << elapsed.count() << ", found " << found
+       << '\n';
+
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    sm_remove(ht, keys[i].c_str(), 0);
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Remove: " << elapsed.count() << '\n';
+  sm_free(ht);
+
+  cout << "*** strset ***\n";
+  STRSET *ss = ss_create_ex(0, &opts);
+  if (!ss) {
+    cout << "Error: options\n";
+    return 1;
+  }
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    ss_add(ss, keys[i].c_str());
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Insert " << ss_size(ss) << " keys: " << elapsed.count() << '\n';
+  print_memory(ss);
+
+  found = 0;
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    found += ss_contains(ss, keys[i].c_str());
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Lookup existing: " << elapsed.count() << ", found " << found
+       << '\n';
+
+  found = 0;
+  t1 = Clock::now();
+  for (size_t i = 0; i < xkeys.size(); i++) {
+    found += ss_contains(ss, xkeys[i].c_str());
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Lookup not existing: " << elapsed.count() << ", found " << found
+       << '\n';
+
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    ss_remove(ss, keys[i].c_str());
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Remove: " << elapsed.count() << '\n';
+  ss_free(ss);
+
+  cout << "*** STL unordered_set ***\n";
+  unordered_set<string> set;
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    set.insert(keys[i]);
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Insert " << set.size() << " keys: " << elapsed.count() << '\n';
+
+  found = 0;
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    found += set.count(keys[i]);
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Lookup existing: " << elapsed.count() << ", found " << found
+       << '\n';
+
+  found = 0;
+  t1 = Clock::now();
+  for (size_t i = 0; i < xkeys.size(); i++) {
+    found += set.count(xkeys[i]);
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Lookup not existing: " << elapsed.count() << ", found " << found
+       << '\n';
+
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    set.erase(keys[i]);
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Remove: " << elapsed.count() << '\n';
+}
@@ -0,0 +1,143 @@
+// command line options shared by the benchmarks, strmap.hpp runs next to
+// the C API ones, template arguments follow the same options
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "strmap.h"
+#include "strmap.hpp"
+
+// strmap options from argv[first] on, e.g. ./bench robin
+inline SM_OPTIONS options(int argc, char **argv, int first) {
+  static const struct {
+    const char *name;
+    unsigned int flag;
+  } FLAGS[] = {{"split", SM_SPLIT},
+               {"swiss", SM_SWISS},
+               {"robin", SM_ROBIN_HOOD},
+               {"pow2", SM_POW2},
+               {"inline", SM_INLINE_KEYS},
+               {"incremental", SM_INCREMENTAL},
+               {"own", SM_OWN_KEYS},
+               {"huge", SM_HUGE_PAGES},
+               {"compact", SM_COMPACT},
+               {"dirty", SM_DIRTY_LOG},
+               {"inplace", SM_INPLACE_GROW}};
+  static const struct {
+    const char *name;
+    SM_HASH hash;
+  } HASHES[] = {{"wy", sm_hash_wy}, {"crc32c", sm_hash_crc32c}};
+  SM_OPTIONS opts = {SM_DEFAULT, 0, 0, 0, 0};
+
+  for (int i = first; i < argc; i++) {
+    for (size_t j = 0; j < sizeof(FLAGS) / sizeof(FLAGS[0]); j++) {
+      if (!strcmp(argv[i], FLAGS[j].name)) {
+        opts.flags |= FLAGS[j].flag;
+      }
+    }
+    for (size_t j = 0; j < sizeof(HASHES) / sizeof(HASHES[0]); j++) {
+      if (!strcmp(argv[i], HASHES[j].name)) {
+        opts.hash = HASHES[j].hash;
+      }
+    }
+    if (!strcmp(argv[i], "shrink")) {
+      opts.shrink = 25;
+    }
+  }
+  return opts;
+}
+
+template <class Map>
+void run_template(const std::vector<std::string> &keys,
+                  const std::vector<std::string> &xkeys) {
+  typedef std::chrono::high_resolution_clock Clock;
+  std::chrono::duration<double> elapsed;
+  Map ht;
+  size_t sum = 0;
+
+  auto t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (ht.insert(keys[i].c_str(), keys[i].size(), 1551) != SM_INSERTED) {
+      std::cout << "Error: " << keys[i] << '\n';
+    }
+  }
+  auto t2 = Clock::now();
+  elapsed = t2 - t1;
+  std::cout << "Insert: " << elapsed.count() << '\n';
+  std::cout << "Load factor: " << ht.load_factor() << '\n';
+  std::cout << "Mean: " << ht.probes_mean() << '\n';
+
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    const int *data = ht.find(keys[i].c_str());
+    if (!data || *data != 1551) {
+      std::cout << "Error: " << keys[i] << '\n';
+    }
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  std::cout << "Lookup existing: " << elapsed.count() << '\n';
+
+  t1 = Clock::now();
+  for (size_t i = 0; i < xkeys.size(); i++) {
+    if (ht.find(xkeys[i].c_str())) {
+      std::cout << "Error: " << xkeys[i] << '\n';
+    }
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  std::cout << "Lookup not existing: " << elapsed.count() << '\n';
+
+  t1 = Clock::now();
+  ht.for_each([&sum](const typename Map::entry &e) { sum += e.len; });
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  std::cout << "Foreach: " << elapsed.count() << ", bytes " << sum << '\n';
+
+  t1 = Clock::now();
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (ht.remove(keys[i].c_str()) != SM_REMOVED) {
+      std::cout << "Error: " << keys[i] << '\n';
+    }
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  std::cout << "Remove: " << elapsed.count() << '\n';
+}
+
+template <class Hash>
+void run_template_layout(const SM_OPTIONS &opts,
+                         const std::vector<std::string> &keys,
+                         const std::vector<std::string> &xkeys) {
+  unsigned int layout = opts.flags & (SM_ROBIN_HOOD | SM_POW2);
+
+  if (layout == (SM_ROBIN_HOOD | SM_POW2)) {
+    run_template<sm::basic_strmap<int, Hash, sm::robin_hood_on<sm::pow2> > >(
+        keys, xkeys);
+  } else if (layout == SM_ROBIN_HOOD) {
+    run_template<sm::basic_strmap<int, Hash, sm::robin_hood> >(keys, xkeys);
+  } else if (layout == SM_POW2) {
+    run_template<sm::basic_strmap<int, Hash, sm::pow2> >(keys, xkeys);
+  } else {
+    run_template<sm::basic_strmap<int, Hash, sm::linear> >(keys, xkeys);
+  }
+}
+
+// default layout for flags without a template layout (split, swiss, ...)
+void run_templates(const SM_OPTIONS &opts,
+                   const std::vector<std::string> &keys,
+                   const std::vector<std::string> &xkeys) {
+  std::cout << "*******************************\n";
+  std::cout << "*** strmap.hpp basic_strmap ***\n";
+  std::cout << "*******************************\n";
+
+  if (opts.hash == sm_hash_wy) {
+    run_template_layout<sm::wy_hash>(opts, keys, xkeys);
+  } else if (opts.hash == sm_hash_crc32c) {
+    run_template_layout<sm::crc32c_hash>(opts, keys, xkeys);
+  } else {
+    run_template_layout<sm::poly_hash>(opts, keys, xkeys);
+  }
+}
@@ -3,13 +3,14 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
-//#define USE_FAST_REDUCE 1
-//#include <cassert>
 #include "strmap.h"
+#include "template_bench.h"
 
 typedef std::chrono::high_resolution_clock Clock;
 
@@ -27,13 +28,30 @@ void fisher_yates_shuffle(char *s) {
 
 using namespace std;
 
-// sm_foreach callback
+// sm_foreach callback, ctx - map options
 void check_hash(SM_ENTRY item, void *ctx) {
-  if (poly_hashs(item.key) != item.hash) {
+  SM_OPTIONS *opts = (SM_OPTIONS *)ctx;
+  size_t hash =
+      opts->hash ? opts->hash(item.key, item.len) : poly_hashs(item.key);
+
+  // SM_COMPACT keeps low 32 bits
+  if (opts->flags & SM_COMPACT) {
+    hash = (unsigned int)hash;
+  }
+  if (hash != item.hash) {
     cout << "Hash error: " << item.hash << '\n';
   }
 }
 
+// sm_memory_usage breakdown
+void print_memory(const STRMAP *ht) {
+  SM_MEMORY usage;
+
+  sm_memory_usage(ht, &usage);
+  cout << "Memory: " << usage.total << " bytes, table " << usage.table
+       << ", keys " << usage.keys << ", per key " << usage.per_key << '\n';
+}
+
 int main(int argc, char **argv) {
   string str = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
   string xstr = "ZbcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -55,6 +73,7 @@ int main(int argc, char **argv) {
 
   STRMAP *nht;
   STRMAP *ht;
+  SM_OPTIONS opts = options(argc, argv, 1);
 
   auto t1 = Clock::now();
   // Load words
@@ -91,7 +110,7 @@ int main(int argc, char **argv) {
   cout << "*** strmap words test ***\n";
   cout << "*************************\n";
 
-  ht = sm_create(keys.size());
+  ht = sm_create_ex(keys.size(), &opts);
 
   t1 = Clock::now();
   for (size_t i = 0; i < keys.size(); i++) {
@@ -107,9 +126,10 @@ int main(int argc, char **argv) {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
-  sm_foreach(ht, check_hash, 0);
+  sm_foreach(ht, check_hash, &opts);
   t2 = Clock::now();
   elapsed = t2 - t1;
   cout << "Foreach check_hash(): " << elapsed.count() << '\n';
@@ -181,6 +201,7 @@ int main(int argc, char **argv) {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (size_t i = 0; i < keys.size(); i++) {
@@ -195,6 +216,7 @@ int main(int argc, char **argv) {
 
   cout << "Mean: " << sm_probes_mean(ht) << '\n';
   cout << "Variance: " << sm_probes_var(ht) << '\n';
+  print_memory(ht);
 
   t1 = Clock::now();
   for (size_t i = 0; i < keys.size(); i++) {
@@ -213,6 +235,78 @@ int main(int argc, char **argv) {
 
   sm_free(ht);
 
+  // sm_build from a key array, against the sm_insert loop above
+  vector<const char *> ptrs(keys.size());
+  vector<const void *> datas(keys.size(), &val);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ptrs[i] = keys[i].c_str();
+  }
+  for (unsigned threads : {1u, max(1u, thread::hardware_concurrency())}) {
+    t1 = Clock::now();
+    ht = sm_build_ex(ptrs.data(), datas.data(), ptrs.size(), threads, &opts);
+    t2 = Clock::now();
+    elapsed = t2 - t1;
+    cout << "Build " << sm_size(ht) << " keys, " << threads
+         << " threads: " << elapsed.count() << '\n';
+    sm_free(ht);
+  }
+
+  // counters behind data pointers, spread as separately allocated ones,
+  // against counters stored in the map
+  vector<unsigned long> counts(keys.size());
+  vector<size_t> slots(keys.size());
+  size_t next = 0;
+  unsigned long total = 0;
+
+  for (size_t i = 0; i < slots.size(); i++) {
+    slots[i] = i;
+  }
+  shuffle(slots.begin(), slots.end(), mt19937(1));
+
+  ht = sm_create_ex(0, &opts);
+  t1 = Clock::now();
+  for (int r = 0; r < 3; r++) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (sm_insert(ht, keys[i].c_str(), &counts[slots[next]],
+                    &rentry) ==
+          SM_INSERTED) {
+        ++next;
+      }
+      ++*(unsigned long *)rentry.data;
+    }
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    sm_lookup(ht, keys[i].c_str(), &rentry);
+    total += *(unsigned long *)rentry.data;
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Count words, data pointers: " << elapsed.count() << ", total "
+       << total << '\n';
+  sm_free(ht);
+
+  opts.value_size = sizeof(unsigned long);
+  ht = sm_create_ex(0, &opts);
+  total = 0;
+  t1 = Clock::now();
+  for (int r = 0; r < 3; r++) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      ++*(unsigned long *)sm_emplace(ht, keys[i].c_str(), 0);
+    }
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    total += *(unsigned long *)sm_value(ht, keys[i].c_str());
+  }
+  t2 = Clock::now();
+  elapsed = t2 - t1;
+  cout << "Count words, value_size: " << elapsed.count() << ", total "
+       << total << '\n';
+  print_memory(ht);
+  sm_free(ht);
+  opts.value_size = 0;
+
+  run_templates(opts, keys, xkeys);
+
   cout << "******************************\n";
   cout << "*** STL unordered_map test ***\n";
   cout << "******************************\n";
@@ -0,0 +1,556 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file lfmap.c
+  @brief SM_LFMAP - lock-free insert only string map, threads publish
+  immutable nodes into slots with compare and swap and help each other
+  grow the table
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "lfmap.h"
+#include "strmap_int.h"
+
+#if !defined(__GNUC__)
+#error "lfmap.c needs GCC compatible __atomic builtins"
+#endif
+
+#define LOAD(p, order) __atomic_load_n((p), (order))
+#define STORE(p, v, order) __atomic_store_n((p), (v), (order))
+#define CAS(p, expected, v) \
+    __atomic_compare_exchange_n((p), (expected), (v), 0, \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+
+#define MIN_CAPACITY 16
+#define MAX_LOAD 70             /* percent of slots claimed before growth */
+
+/* claimed slots are counted per stripe of slot index, a stripe over its
+   share of the load starts growth; tables below STRIPED use one */
+#define STRIPES 64
+#define STRIPED 4096
+
+/* slots migrated by a helper at a time */
+#define CHUNK 4096
+
+/* nodes per allocation */
+#define NODES 1024
+
+/* key, data, hash and length are written before the node is published
+   and never change after, so no reader waits for a field */
+typedef struct SM_LNODES {
+    struct SM_LNODES *next;     /* older block */
+    size_t used;                /* nodes taken, passes NODES when full */
+    SM_ENTRY nodes[NODES];
+} SM_LNODES;
+
+typedef union SM_COUNTER {
+    size_t n;
+    char line[SM_CACHE_LINE];
+} SM_COUNTER;
+
+typedef struct SM_LTABLE {
+    SM_COUNTER count[STRIPES];  /* claimed slots */
+    SM_COUNTER chunk;           /* next chunk to claim */
+    struct SM_LTABLE *next;     /* larger table, set once growth starts */
+    const SM_ENTRY **slots;     /* NULL - empty, &MOVED - empty, migrated */
+    unsigned char *done;        /* migrated chunks */
+    size_t chunks;
+    size_t capacity;            /* power of two */
+    size_t mask;                /* stripe of slot `i` is `i & mask` */
+    size_t limit;               /* claims per stripe */
+    size_t bytes;
+    void *block;                /* table allocation */
+} SM_LTABLE;
+
+struct SM_LFMAP {
+    SM_LTABLE *current;         /* table inserts go to */
+    SM_LTABLE *first;           /* tables are chained by next, lookups may
+                                   read old ones until sm_lf_free */
+    SM_LNODES *nodes;           /* newest node block first */
+    SM_HASH hash;
+    const SM_ALLOCATOR *alloc;  /* NULL - malloc and free */
+};
+
+/* migrated empty slot, probes continue in the next table */
+static const SM_ENTRY MOVED = { 0, 0, 0, 0 };
+
+static SM_LTABLE *table_create(const SM_LFMAP * sm, size_t capacity);
+static SM_ENTRY *node_create(SM_LFMAP * sm);
+static const SM_ENTRY *lookup(SM_LFMAP * sm, const char *key, size_t len,
+                              size_t hash);
+static int put(SM_LTABLE * t, const SM_ENTRY * node,
+               const SM_ENTRY ** found, size_t * slot);
+static int find(const SM_LTABLE * t, const char *key, size_t len,
+                size_t hash, const SM_ENTRY ** found);
+static int expand(SM_LFMAP * sm, SM_LTABLE * t);
+static void help(SM_LFMAP * sm, SM_LTABLE * t);
+static void migrate(SM_LTABLE * t, SM_LTABLE * next, size_t chunk);
+static size_t position(const SM_LTABLE * t, size_t hash);
+
+SM_LFMAP *
+sm_lf_create(size_t size, const SM_OPTIONS * opts)
+{
+    SM_LFMAP *sm;
+    const SM_ALLOCATOR *alloc = (opts ? opts->alloc : 0);
+    size_t capacity;
+
+    if (opts && ((opts->flags & ~(unsigned int)SM_POW2) || opts->value_size)) {
+        errno = EINVAL;
+        return 0;
+    }
+    for (capacity = MIN_CAPACITY; capacity * MAX_LOAD / 100 < size;
+         capacity <<= 1) {
+        if (capacity > ((size_t)-1) / 4 / sizeof (SM_ENTRY *)) {
+            errno = ENOMEM;
+            return 0;
+        }
+    }
+
+    if (!(sm = (SM_LFMAP *) sm_allocate(alloc, sizeof (SM_LFMAP)))) {
+        errno = ENOMEM;
+        return 0;
+    }
+    sm->hash = (opts && opts->hash ? opts->hash : poly_hashn);
+    sm->alloc = alloc;
+    sm->nodes = 0;
+    if (!(sm->first = table_create(sm, capacity))) {
+        sm_release(alloc, sm);
+        errno = ENOMEM;
+        return 0;
+    }
+    sm->current = sm->first;
+
+    return sm;
+}
+
+SM_RESULT
+sm_lf_insert(SM_LFMAP * sm, const char *key, const void *data,
+             SM_ENTRY * item)
+{
+    return sm_lf_insert_n(sm, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_lf_insert_n(SM_LFMAP * sm, const char *key, size_t len, const void *data,
+               SM_ENTRY * item)
+{
+    SM_LTABLE *t;
+    SM_ENTRY *node;
+    const SM_ENTRY *found;
+    size_t hash, i, c;
+    int res;
+
+    assert(sm);
+    assert(key);
+
+    hash = sm->hash(key, len);
+    /* present keys take no node, a node is lost only to a concurrent
+       insert of the same key */
+    if ((found = lookup(sm, key, len, hash))) {
+        if (item) {
+            *item = *found;
+        }
+        return SM_DUPLICATE;
+    }
+    if (!(node = node_create(sm))) {
+        return SM_MAP_FULL;
+    }
+    node->key = key;
+    node->data = data;
+    node->hash = hash;
+    node->len = len;
+
+    for (;;) {
+        t = LOAD(&sm->current, __ATOMIC_ACQUIRE);
+        if (LOAD(&t->next, __ATOMIC_ACQUIRE)) {
+            /* no key is in both tables, finish the move first */
+            help(sm, t);
+            continue;
+        }
+        res = put(t, node, &found, &i);
+        if (res >= 0) {
+            if (item) {
+                *item = *found;
+            }
+            if (res) {
+                c = ADD(&t->count[i & t->mask].n, 1);
+                if (c + 1 > t->limit && expand(sm, t)) {
+                    help(sm, t);
+                }
+            }
+            return res ? SM_INSERTED : SM_DUPLICATE;
+        }
+        /* migrated slot on the probe path or table full */
+        if (!expand(sm, t)) {
+            return SM_MAP_FULL;
+        }
+        help(sm, t);
+    }
+}
+
+SM_RESULT
+sm_lf_lookup(SM_LFMAP * sm, const char *key, SM_ENTRY * item)
+{
+    return sm_lf_lookup_n(sm, key, strlen(key), item);
+}
+
+SM_RESULT
+sm_lf_lookup_n(SM_LFMAP * sm, const char *key, size_t len, SM_ENTRY * item)
+{
+    const SM_ENTRY *found;
+
+    assert(sm);
+    assert(key);
+
+    if (!(found = lookup(sm, key, len, sm->hash(key, len)))) {
+        return SM_NOT_FOUND;
+    }
+    if (item) {
+        *item = *found;
+    }
+    return SM_FOUND;
+}
+
+size_t
+sm_lf_size(SM_LFMAP * sm)
+{
+    const SM_LTABLE *t;
+    size_t size, i;
+
+    assert(sm);
+
+    t = LOAD(&sm->current, __ATOMIC_ACQUIRE);
+    for (size = 0, i = 0; i <= t->mask; ++i) {
+        size += LOAD(&t->count[i].n, __ATOMIC_RELAXED);
+    }
+    return size;
+}
+
+void
+sm_lf_foreach(SM_LFMAP * sm, void (*action) (SM_ENTRY item, void *ctx),
+              void *ctx)
+{
+    const SM_LTABLE *t;
+    const SM_ENTRY *e;
+    size_t i;
+
+    assert(sm);
+
+    t = sm->current;
+    for (i = 0; i < t->capacity; ++i) {
+        if ((e = t->slots[i]) && e != &MOVED) {
+            action(*e, ctx);
+        }
+    }
+}
+
+size_t
+sm_lf_memory_usage(SM_LFMAP * sm, SM_MEMORY * usage)
+{
+    const SM_LTABLE *t;
+    const SM_LNODES *b;
+    SM_MEMORY m;
+    size_t size;
+
+    assert(sm);
+
+    m.table = m.keys = 0;
+    m.map = sizeof (SM_LFMAP);
+    for (t = sm->first; t; t = LOAD(&t->next, __ATOMIC_ACQUIRE)) {
+        m.table += t->bytes;
+    }
+    for (b = LOAD(&sm->nodes, __ATOMIC_ACQUIRE); b; b = b->next) {
+        m.table += sizeof (SM_LNODES);
+    }
+    size = sm_lf_size(sm);
+    m.total = m.table + m.map;
+    m.per_key = (size ? (double)m.total / (double)size : 0.0);
+    if (usage) {
+        *usage = m;
+    }
+    return m.total;
+}
+
+void
+sm_lf_free(SM_LFMAP * sm)
+{
+    SM_LTABLE *t, *next;
+    SM_LNODES *b, *older;
+
+    if (!sm) {
+        return;
+    }
+    for (t = sm->first; t; t = next) {
+        next = t->next;
+        sm_release(sm->alloc, t->block);
+    }
+    for (b = sm->nodes; b; b = older) {
+        older = b->next;
+        sm_release(sm->alloc, b);
+    }
+    sm_release(sm->alloc, sm);
+}
+
+/*
+ * zero filled table with a SM_CACHE_LINE aligned header, slots and
+ * chunk flags follow it
+ */
+static SM_LTABLE *
+table_create(const SM_LFMAP * sm, size_t capacity)
+{
+    SM_LTABLE *t;
+    void *block;
+    size_t bytes, chunks, stripes;
+
+    chunks = (capacity + CHUNK - 1) / CHUNK;
+    bytes = sizeof (SM_LTABLE) + SM_CACHE_LINE
+        + capacity * sizeof (SM_ENTRY *) + chunks;
+    if (!(block = sm_allocate(sm->alloc, bytes))) {
+        return 0;
+    }
+    memset(block, 0, bytes);
+    t = (SM_LTABLE *) SM_CACHE_ALIGN(block);
+    stripes = (capacity < STRIPED ? 1 : STRIPES);
+    t->next = 0;
+    t->slots = (const SM_ENTRY **) (t + 1);
+    t->done = (unsigned char *) (t->slots + capacity);
+    t->chunks = chunks;
+    t->capacity = capacity;
+    t->mask = stripes - 1;
+    t->limit = capacity * MAX_LOAD / 100 / stripes;
+    t->bytes = bytes;
+    t->block = block;
+
+    return t;
+}
+
+/*
+ * node from the newest block, a thread finding it full pushes a new
+ * one; the loser of that push frees its block and retries
+ */
+static SM_ENTRY *
+node_create(SM_LFMAP * sm)
+{
+    SM_LNODES *b, *fresh;
+    size_t n;
+
+    for (;;) {
+        b = LOAD(&sm->nodes, __ATOMIC_ACQUIRE);
+        if (b && (n = ADD(&b->used, 1)) < NODES) {
+            return b->nodes + n;
+        }
+        if (!(fresh = (SM_LNODES *) sm_allocate(sm->alloc,
+                                                sizeof (SM_LNODES)))) {
+            return 0;
+        }
+        fresh->next = b;
+        fresh->used = 1;
+        if (CAS(&sm->nodes, &b, fresh)) {
+            return fresh->nodes;
+        }
+        sm_release(sm->alloc, fresh);
+    }
+}
+
+/*
+ * node of key in the current table or, past migrated slots, in the
+ * tables after it; NULL - not found
+ */
+static const SM_ENTRY *
+lookup(SM_LFMAP * sm, const char *key, size_t len, size_t hash)
+{
+    const SM_LTABLE *t;
+    const SM_ENTRY *found;
+    int res;
+
+    t = LOAD(&sm->current, __ATOMIC_ACQUIRE);
+    while ((res = find(t, key, len, hash, &found)) < 0) {
+        if (!(t = LOAD(&t->next, __ATOMIC_ACQUIRE))) {
+            return 0;
+        }
+    }
+    return res ? found : 0;
+}
+
+/*
+ * publish node in the first empty slot of its probe sequence with one
+ * CAS; `found` receives the node in the slot, the key's node if it was
+ * present. 1 - inserted, 0 - key present, -1 - migrated slot or table
+ * full. Migration puts the same nodes again, a node met is its own key
+ */
+static int
+put(SM_LTABLE * t, const SM_ENTRY * node, const SM_ENTRY ** found,
+    size_t * slot)
+{
+    const SM_ENTRY **s, *e;
+    size_t i, n;
+
+    i = position(t, node->hash);
+    for (n = 0; n < t->capacity; ++n) {
+        s = t->slots + i;
+        e = LOAD(s, __ATOMIC_ACQUIRE);
+        if (!e) {
+            if (CAS(s, &e, node)) {
+                *found = node;
+                *slot = i;
+                return 1;
+            }
+            /* lost the slot, `e` is the winner's node */
+        }
+        if (e == &MOVED) {
+            return -1;
+        }
+        if (e == node || (e->hash == node->hash && e->len == node->len
+                          && !memcmp(node->key, e->key, node->len))) {
+            *found = e;
+            *slot = i;
+            return 0;
+        }
+        i = (i + 1) & (t->capacity - 1);
+    }
+
+    return -1;
+}
+
+/*
+ * 1 - found, 0 - not found, -1 - continue in the next table
+ */
+static int
+find(const SM_LTABLE * t, const char *key, size_t len, size_t hash,
+     const SM_ENTRY ** found)
+{
+    const SM_ENTRY *e;
+    size_t i, n;
+
+    i = position(t, hash);
+    for (n = 0; n < t->capacity; ++n) {
+        e = LOAD(t->slots + i, __ATOMIC_ACQUIRE);
+        if (!e) {
+            return 0;
+        }
+        if (e == &MOVED) {
+            return -1;
+        }
+        if (e->hash == hash && e->len == len && !memcmp(key, e->key, len)) {
+            *found = e;
+            return 1;
+        }
+        i = (i + 1) & (t->capacity - 1);
+    }
+
+    return -1;
+}
+
+/*
+ * attach a table twice as large unless another thread did;
+ * 0 - no memory
+ */
+static int
+expand(SM_LFMAP * sm, SM_LTABLE * t)
+{
+    SM_LTABLE *next, *expected = 0;
+
+    if (LOAD(&t->next, __ATOMIC_ACQUIRE)) {
+        return 1;
+    }
+    if (t->capacity > ((size_t)-1) / 4 / sizeof (SM_ENTRY *)
+        || !(next = table_create(sm, t->capacity * 2))) {
+        return LOAD(&t->next, __ATOMIC_ACQUIRE) != 0;
+    }
+    if (!CAS(&t->next, &expected, next)) {
+        sm_release(sm->alloc, next->block);
+    }
+    return 1;
+}
+
+/*
+ * migrate unclaimed chunks of `t`, then redo the chunks not done yet,
+ * their claimers may be stalled; copying is idempotent, so no thread
+ * waits for another. Every chunk is done on return and the next table
+ * is published
+ */
+static void
+help(SM_LFMAP * sm, SM_LTABLE * t)
+{
+    SM_LTABLE *next = LOAD(&t->next, __ATOMIC_ACQUIRE), *expected = t;
+    size_t c;
+
+    while ((c = ADD(&t->chunk.n, 1)) < t->chunks) {
+        migrate(t, next, c);
+    }
+    for (c = 0; c < t->chunks; ++c) {
+        if (!LOAD(&t->done[c], __ATOMIC_ACQUIRE)) {
+            migrate(t, next, c);
+        }
+    }
+    CAS(&sm->current, &expected, next);
+}
+
+/*
+ * empty slots become MOVED, so no insert lands in them; nodes are put
+ * into the next table and stay in `t` for lookups
+ */
+static void
+migrate(SM_LTABLE * t, SM_LTABLE * next, size_t chunk)
+{
+    const SM_ENTRY **s, *e;
+    const SM_ENTRY *found;
+    size_t i, j, stop;
+
+    stop = (chunk + 1) * CHUNK;
+    stop = (stop < t->capacity ? stop : t->capacity);
+    for (i = chunk * CHUNK; i < stop; ++i) {
+        s = t->slots + i;
+        e = 0;
+        if (CAS(s, &e, &MOVED) || e == &MOVED) {
+            continue;
+        }
+        if (put(next, e, &found, &j) == 1) {
+            ADD(&next->count[j & next->mask].n, 1);
+        }
+    }
+    STORE(&t->done[chunk], 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * SM_POW2 position of `hash`
+ */
+static size_t
+position(const SM_LTABLE * t, size_t hash)
+{
+    SM_MIX(hash);
+    return hash & (t->capacity - 1);
+}
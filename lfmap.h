@@ -0,0 +1,104 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file lfmap.h
+  @brief SM_LFMAP - lock-free insert only string map, threads publish
+  immutable nodes into slots with compare and swap and help each other
+  grow the table
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#ifndef _LFMAP_H
+#define _LFMAP_H
+
+#include "strmap.h"
+
+typedef struct SM_LFMAP SM_LFMAP;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  @brief Create a map which can contain at least `size` keys before it
+  grows; of `opts` (may be NULL) `hash` and `alloc` are used, `flags`
+  must be SM_DEFAULT or SM_POW2 (capacity is a power of two) and
+  `value_size` 0; the allocator is called from inserting threads
+  @return map or NULL with errno set to ENOMEM or EINVAL
+*/
+    SM_LFMAP *sm_lf_create(size_t size, const SM_OPTIONS * opts);
+
+/**
+  @brief Insert key unless it is present, any number of threads, no
+  thread waits for another; keys are borrowed and never removed
+  @return SM_INSERTED, SM_DUPLICATE or SM_MAP_FULL if a node or a larger
+  table can not be allocated
+*/
+    SM_RESULT sm_lf_insert(SM_LFMAP * sm, const char *key, const void *data,
+                           SM_ENTRY * item);
+    SM_RESULT sm_lf_insert_n(SM_LFMAP * sm, const char *key, size_t len,
+                             const void *data, SM_ENTRY * item);
+
+/**
+  @brief Lookup concurrent with inserts, never waits
+  @return SM_FOUND on success, SM_NOT_FOUND otherwise
+*/
+    SM_RESULT sm_lf_lookup(SM_LFMAP * sm, const char *key, SM_ENTRY * item);
+    SM_RESULT sm_lf_lookup_n(SM_LFMAP * sm, const char *key, size_t len,
+                             SM_ENTRY * item);
+
+/**
+  @brief Number of keys, exact when no insert runs
+*/
+    size_t sm_lf_size(SM_LFMAP * sm);
+
+/**
+  @brief For each callback, no insert may run
+*/
+    void sm_lf_foreach(SM_LFMAP * sm,
+                       void (*action) (SM_ENTRY item, void *ctx),
+                       void *ctx);
+
+/**
+  @brief Bytes allocated for the map, tables replaced by growth included,
+  `usage` may be NULL
+  @return total bytes
+*/
+    size_t sm_lf_memory_usage(SM_LFMAP * sm, SM_MEMORY * usage);
+
+/**
+  @brief Free the map and all its tables, no other thread may use it
+*/
+    void sm_lf_free(SM_LFMAP * sm);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
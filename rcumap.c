@@ -0,0 +1,399 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file rcumap.c
+  @brief SM_RCU - string map with lock-free readers and a single writer,
+  readers look up a published copy of the map while the writer updates
+  the other one
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L /* pthread, sched_yield under -ansi */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "rcumap.h"
+#include "strmap_int.h"
+
+#if !defined(__GNUC__)
+#error "rcumap.c needs GCC compatible __atomic builtins"
+#endif
+
+/* reader announcements and the published index, sequentially consistent
+   store-load order between readers and the writer */
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#define DEFAULT_READERS 64
+#define MAX_READERS 65536
+
+/* readers on separate cache lines, a reader writes its own line only */
+typedef union SM_READER {
+    unsigned int map;           /* 0 - idle, 1 + index of the map read */
+    char line[SM_CACHE_LINE];
+} SM_READER;
+
+typedef enum SM_OP {
+    OP_INSERT,
+    OP_UPDATE,
+    OP_UPSERT,
+    OP_REMOVE
+} SM_OP;
+
+struct SM_RCU {
+    STRMAP *maps[2];            /* same keys between writes */
+    unsigned int front;         /* map readers enter */
+    pthread_mutex_t lock;       /* writers */
+    SM_READER *readers;         /* SM_CACHE_LINE aligned */
+    unsigned int count;
+    const SM_ALLOCATOR *alloc;  /* NULL - malloc and free */
+    void *block;                /* readers allocation */
+};
+
+static const STRMAP *enter(SM_RCU * sm, unsigned int reader);
+static void leave(SM_RCU * sm, unsigned int reader);
+static void publish(SM_RCU * sm);
+static SM_RESULT modify(SM_RCU * sm, SM_OP op, const char *key, size_t len,
+                       const void *data, SM_ENTRY * item);
+static SM_RESULT apply(STRMAP * map, SM_OP op, const char *key, size_t len,
+                       const void *data, SM_ENTRY * item);
+
+SM_RCU *
+sm_rcu_create(size_t size, unsigned int readers, const SM_OPTIONS * opts)
+{
+    SM_RCU *sm;
+    const SM_ALLOCATOR *alloc = (opts ? opts->alloc : 0);
+
+    if (readers > MAX_READERS) {
+        errno = EINVAL;
+        return 0;
+    }
+    readers = (readers ? readers : DEFAULT_READERS);
+
+    if (!(sm = (SM_RCU *) sm_allocate(alloc, sizeof (SM_RCU)))) {
+        errno = ENOMEM;
+        return 0;
+    }
+    sm->alloc = alloc;
+    sm->count = readers;
+    sm->front = 0;
+    sm->maps[0] = sm_create_ex(size, opts);
+    sm->maps[1] = (sm->maps[0] ? sm_create_ex(size, opts) : 0);
+    sm->block = sm_allocate(alloc,
+                            readers * sizeof (SM_READER) + SM_CACHE_LINE);
+    if (!sm->maps[1] || !sm->block || pthread_mutex_init(&sm->lock, 0)) {
+        if (sm->maps[1]) {
+            sm_free(sm->maps[1]);
+            errno = ENOMEM;
+        }
+        if (sm->maps[0]) {
+            sm_free(sm->maps[0]);
+        }
+        sm_release(alloc, sm->block);
+        sm_release(alloc, sm);
+        return 0;
+    }
+    sm->readers = (SM_READER *) SM_CACHE_ALIGN(sm->block);
+    memset(sm->readers, 0, readers * sizeof (SM_READER));
+
+    return sm;
+}
+
+SM_RESULT
+sm_rcu_lookup(SM_RCU * sm, unsigned int reader, const char *key,
+              SM_ENTRY * item)
+{
+    return sm_rcu_lookup_n(sm, reader, key, strlen(key), item);
+}
+
+SM_RESULT
+sm_rcu_lookup_n(SM_RCU * sm, unsigned int reader, const char *key,
+                size_t len, SM_ENTRY * item)
+{
+    SM_RESULT res;
+
+    res = sm_lookup_n(enter(sm, reader), key, len, item);
+    leave(sm, reader);
+
+    return res;
+}
+
+void
+sm_rcu_read(SM_RCU * sm, unsigned int reader,
+            void (*action) (const STRMAP * map, void *ctx), void *ctx)
+{
+    action(enter(sm, reader), ctx);
+    leave(sm, reader);
+}
+
+SM_RESULT
+sm_rcu_insert(SM_RCU * sm, const char *key, const void *data,
+              SM_ENTRY * item)
+{
+    return modify(sm, OP_INSERT, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_rcu_update(SM_RCU * sm, const char *key, const void *data,
+              SM_ENTRY * item)
+{
+    return modify(sm, OP_UPDATE, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_rcu_upsert(SM_RCU * sm, const char *key, const void *data,
+              SM_ENTRY * item)
+{
+    return modify(sm, OP_UPSERT, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_rcu_remove(SM_RCU * sm, const char *key, SM_ENTRY * item)
+{
+    return modify(sm, OP_REMOVE, key, strlen(key), 0, item);
+}
+
+SM_RESULT
+sm_rcu_insert_n(SM_RCU * sm, const char *key, size_t len, const void *data,
+                SM_ENTRY * item)
+{
+    return modify(sm, OP_INSERT, key, len, data, item);
+}
+
+SM_RESULT
+sm_rcu_update_n(SM_RCU * sm, const char *key, size_t len, const void *data,
+                SM_ENTRY * item)
+{
+    return modify(sm, OP_UPDATE, key, len, data, item);
+}
+
+SM_RESULT
+sm_rcu_upsert_n(SM_RCU * sm, const char *key, size_t len, const void *data,
+                SM_ENTRY * item)
+{
+    return modify(sm, OP_UPSERT, key, len, data, item);
+}
+
+SM_RESULT
+sm_rcu_remove_n(SM_RCU * sm, const char *key, size_t len, SM_ENTRY * item)
+{
+    return modify(sm, OP_REMOVE, key, len, 0, item);
+}
+
+void
+sm_rcu_clear(SM_RCU * sm)
+{
+    assert(sm);
+
+    pthread_mutex_lock(&sm->lock);
+    sm_clear(sm->maps[1 - sm->front]);
+    publish(sm);
+    sm_clear(sm->maps[1 - sm->front]);
+    pthread_mutex_unlock(&sm->lock);
+}
+
+int
+sm_rcu_reserve(SM_RCU * sm, size_t size)
+{
+    int res;
+
+    assert(sm);
+
+    pthread_mutex_lock(&sm->lock);
+    res = sm_reserve(sm->maps[1 - sm->front], size);
+    if (!res) {
+        publish(sm);
+        res = sm_reserve(sm->maps[1 - sm->front], size);
+    }
+    pthread_mutex_unlock(&sm->lock);
+
+    return res;
+}
+
+size_t
+sm_rcu_size(SM_RCU * sm)
+{
+    size_t size;
+
+    assert(sm);
+
+    pthread_mutex_lock(&sm->lock);
+    size = sm_size(sm->maps[sm->front]);
+    pthread_mutex_unlock(&sm->lock);
+
+    return size;
+}
+
+size_t
+sm_rcu_memory_usage(SM_RCU * sm, SM_MEMORY * usage)
+{
+    SM_MEMORY m, s;
+    size_t size;
+    int i;
+
+    assert(sm);
+
+    m.table = m.keys = 0;
+    m.map = sizeof (SM_RCU) + sm->count * sizeof (SM_READER) + SM_CACHE_LINE;
+    pthread_mutex_lock(&sm->lock);
+    for (i = 0; i < 2; ++i) {
+        sm_memory_usage(sm->maps[i], &s);
+        m.table += s.table;
+        m.map += s.map;
+        m.keys += s.keys;
+    }
+    size = sm_size(sm->maps[sm->front]);
+    pthread_mutex_unlock(&sm->lock);
+    m.total = m.table + m.map + m.keys;
+    m.per_key = (size ? (double)m.total / (double)size : 0.0);
+    if (usage) {
+        *usage = m;
+    }
+    return m.total;
+}
+
+void
+sm_rcu_free(SM_RCU * sm)
+{
+    if (!sm) {
+        return;
+    }
+    pthread_mutex_destroy(&sm->lock);
+    sm_free(sm->maps[0]);
+    sm_free(sm->maps[1]);
+    sm_release(sm->alloc, sm->block);
+    sm_release(sm->alloc, sm);
+}
+
+/*
+ * announce the map about to be read, then check it is still published;
+ * a writer switching maps in between sees the announcement and waits
+ */
+static const STRMAP *
+enter(SM_RCU * sm, unsigned int reader)
+{
+    SM_READER *r;
+    unsigned int front;
+
+    assert(sm);
+    assert(reader < sm->count);
+
+    r = sm->readers + reader;
+    do {
+        front = LOAD(&sm->front);
+        STORE(&r->map, front + 1);
+    } while (LOAD(&sm->front) != front);
+
+    return sm->maps[front];
+}
+
+static void
+leave(SM_RCU * sm, unsigned int reader)
+{
+    RELEASE(&sm->readers[reader].map, 0u);
+}
+
+/*
+ * readers enter the updated map, wait until the other one is left
+ */
+static void
+publish(SM_RCU * sm)
+{
+    unsigned int i, old;
+
+    old = sm->front;
+    STORE(&sm->front, 1 - old);
+    for (i = 0; i < sm->count; ++i) {
+        while (LOAD(&sm->readers[i].map) == old + 1) {
+            sched_yield();
+        }
+    }
+}
+
+/*
+ * apply to the unpublished map, publish it, repeat on the other one; a
+ * failed second insert is undone on the published map, readers may see
+ * the key for a while
+ */
+static SM_RESULT
+modify(SM_RCU * sm, SM_OP op, const char *key, size_t len, const void *data,
+      SM_ENTRY * item)
+{
+    SM_ENTRY entry;
+    SM_RESULT res;
+    int changed;
+
+    assert(sm);
+    assert(key);
+
+    pthread_mutex_lock(&sm->lock);
+    res = apply(sm->maps[1 - sm->front], op, key, len, data, &entry);
+    changed = (res == SM_INSERTED || res == SM_UPDATED || res == SM_REMOVED);
+    if (changed) {
+        publish(sm);
+        if (apply(sm->maps[1 - sm->front], op, key, len, data, 0)
+            == SM_MAP_FULL) {
+            publish(sm);
+            sm_remove_n(sm->maps[1 - sm->front], key, len, 0);
+            res = SM_MAP_FULL;
+            changed = 0;
+        }
+    }
+    pthread_mutex_unlock(&sm->lock);
+
+    if (item && changed) {
+        *item = entry;
+    }
+    return res;
+}
+
+static SM_RESULT
+apply(STRMAP * map, SM_OP op, const char *key, size_t len, const void *data,
+      SM_ENTRY * item)
+{
+    switch (op) {
+    case OP_INSERT:
+        return sm_insert_n(map, key, len, data, item);
+    case OP_UPDATE:
+        return sm_update_n(map, key, len, data, item);
+    case OP_UPSERT:
+        return sm_upsert_n(map, key, len, data, item);
+    default:
+        return sm_remove_n(map, key, len, item);
+    }
+}
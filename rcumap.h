@@ -0,0 +1,130 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file rcumap.h
+  @brief SM_RCU - string map with lock-free readers and a single writer,
+  readers look up a published copy of the map while the writer updates
+  the other one
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#ifndef _RCUMAP_H
+#define _RCUMAP_H
+
+#include "strmap.h"
+
+typedef struct SM_RCU SM_RCU;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  @brief Create a map which can contain at least `size` keys for
+  `readers` reader threads (0 - 64, at most 65536); two maps with options
+  `opts` (may be NULL) hold the same keys
+  @return map or NULL with errno set to ENOMEM or EINVAL
+*/
+    SM_RCU *sm_rcu_create(size_t size, unsigned int readers,
+                          const SM_OPTIONS * opts);
+
+/**
+  @brief Reader side, `reader` is the index of the calling thread in
+  [0, readers), no two threads use the same index at a time; no locks
+  are taken and no shared cache line is written. `item` is a copy, its
+  key may point into the map (SM_INLINE_KEYS, value_size data) and is
+  valid until the next write
+*/
+    SM_RESULT sm_rcu_lookup(SM_RCU * sm, unsigned int reader,
+                            const char *key, SM_ENTRY * item);
+    SM_RESULT sm_rcu_lookup_n(SM_RCU * sm, unsigned int reader,
+                              const char *key, size_t len, SM_ENTRY * item);
+
+/**
+  @brief Run `action` on the published map, which the writer leaves
+  unchanged until `action` returns; any const sm_* call may be used
+*/
+    void sm_rcu_read(SM_RCU * sm, unsigned int reader,
+                     void (*action) (const STRMAP * map, void *ctx),
+                     void *ctx);
+
+/**
+  @brief Writer side, sm_* counterparts; writers are serialized by a
+  mutex and wait for readers of the copy they update
+  @return SM_MAP_FULL leaves the map unchanged
+*/
+    SM_RESULT sm_rcu_insert(SM_RCU * sm, const char *key, const void *data,
+                            SM_ENTRY * item);
+    SM_RESULT sm_rcu_update(SM_RCU * sm, const char *key, const void *data,
+                            SM_ENTRY * item);
+    SM_RESULT sm_rcu_upsert(SM_RCU * sm, const char *key, const void *data,
+                            SM_ENTRY * item);
+    SM_RESULT sm_rcu_remove(SM_RCU * sm, const char *key, SM_ENTRY * item);
+
+    SM_RESULT sm_rcu_insert_n(SM_RCU * sm, const char *key, size_t len,
+                              const void *data, SM_ENTRY * item);
+    SM_RESULT sm_rcu_update_n(SM_RCU * sm, const char *key, size_t len,
+                              const void *data, SM_ENTRY * item);
+    SM_RESULT sm_rcu_upsert_n(SM_RCU * sm, const char *key, size_t len,
+                              const void *data, SM_ENTRY * item);
+    SM_RESULT sm_rcu_remove_n(SM_RCU * sm, const char *key, size_t len,
+                              SM_ENTRY * item);
+
+/**
+  @brief Remove all keys
+*/
+    void sm_rcu_clear(SM_RCU * sm);
+
+/**
+  @brief Reserve `size` keys in both maps
+  @return 0 on success, -1 with errno set to ENOMEM otherwise
+*/
+    int sm_rcu_reserve(SM_RCU * sm, size_t size);
+
+/**
+  @brief Number of keys, taken under the writer mutex
+*/
+    size_t sm_rcu_size(SM_RCU * sm);
+
+/**
+  @brief Bytes allocated for both maps, `usage` may be NULL
+  @return total bytes
+*/
+    size_t sm_rcu_memory_usage(SM_RCU * sm, SM_MEMORY * usage);
+
+/**
+  @brief Free both maps, no other thread may use the map
+*/
+    void sm_rcu_free(SM_RCU * sm);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,458 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file shardmap.c
+  @brief SM_SHARDED - thread safe string map, keys are spread by hash over
+  independent STRMAP shards, each behind its own mutex
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L /* pthread under -ansi */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "shardmap.h"
+#include "strmap_int.h"
+
+#define DEFAULT_SHARDS 16
+#define MAX_SHARDS 65536
+#define SHARD_BITS 16
+
+typedef struct SM_SHARD_DATA {
+    pthread_mutex_t lock;
+    STRMAP *map;
+} SM_SHARD_DATA;
+
+typedef union SM_SHARD {
+    SM_SHARD_DATA s;
+    char line[SM_CACHE_LINES(sizeof (SM_SHARD_DATA))];
+} SM_SHARD;
+
+struct SM_SHARDED {
+    SM_SHARD *shards;           /* cache line aligned, no false sharing
+                                   of locks */
+    unsigned int count;         /* power of two */
+    SM_HASH hash;               /* shard selection, map hash */
+    const SM_ALLOCATOR *alloc;  /* NULL - malloc and free */
+    void *block;                /* shards allocation */
+};
+
+static SM_SHARD *shard(const SM_SHARDED * sm, size_t hash);
+
+SM_SHARDED *
+sm_sharded_create(size_t size, unsigned int shards, const SM_OPTIONS * opts)
+{
+    SM_SHARDED *sm;
+    const SM_ALLOCATOR *alloc = (opts ? opts->alloc : 0);
+    unsigned int count, i;
+
+    /* value_size: no value pointer outlives the shard lock */
+    if (shards > MAX_SHARDS || (opts && opts->value_size)) {
+        errno = EINVAL;
+        return 0;
+    }
+    for (count = 1; count < (shards ? shards : DEFAULT_SHARDS); count <<= 1) {
+    }
+
+    if (!(sm = (SM_SHARDED *) sm_allocate(alloc, sizeof (SM_SHARDED)))) {
+        errno = ENOMEM;
+        return 0;
+    }
+    sm->count = count;
+    sm->hash = (opts && opts->hash ? opts->hash : poly_hashn);
+    sm->alloc = alloc;
+    sm->block = sm_allocate(alloc, count * sizeof (SM_SHARD) + SM_CACHE_LINE);
+    if (!sm->block) {
+        sm_release(alloc, sm);
+        errno = ENOMEM;
+        return 0;
+    }
+    sm->shards = (SM_SHARD *) SM_CACHE_ALIGN(sm->block);
+
+    for (i = 0; i < count; ++i) {
+        sm->shards[i].s.map = sm_create_ex(size / count, opts);
+        if (!sm->shards[i].s.map
+            || pthread_mutex_init(&sm->shards[i].s.lock, 0)) {
+            if (sm->shards[i].s.map) {
+                sm_free(sm->shards[i].s.map);
+                errno = ENOMEM;
+            }
+            sm->count = i;
+            sm_sharded_free(sm);
+            return 0;
+        }
+    }
+
+    return sm;
+}
+
+SM_RESULT
+sm_sharded_lookup(SM_SHARDED * sm, const char *key, SM_ENTRY * item)
+{
+    return sm_sharded_lookup_n(sm, key, strlen(key), item);
+}
+
+SM_RESULT
+sm_sharded_insert(SM_SHARDED * sm, const char *key, const void *data,
+                  SM_ENTRY * item)
+{
+    return sm_sharded_insert_n(sm, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_sharded_update(SM_SHARDED * sm, const char *key, const void *data,
+                  SM_ENTRY * item)
+{
+    return sm_sharded_update_n(sm, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_sharded_upsert(SM_SHARDED * sm, const char *key, const void *data,
+                  SM_ENTRY * item)
+{
+    return sm_sharded_upsert_n(sm, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_sharded_remove(SM_SHARDED * sm, const char *key, SM_ENTRY * item)
+{
+    return sm_sharded_remove_n(sm, key, strlen(key), item);
+}
+
+SM_RESULT
+sm_sharded_lookup_n(SM_SHARDED * sm, const char *key, size_t len,
+                    SM_ENTRY * item)
+{
+    size_t hash;
+    SM_SHARD *s;
+    SM_RESULT res;
+
+    assert(sm);
+    assert(key);
+
+    hash = sm->hash(key, len);
+    s = shard(sm, hash);
+    pthread_mutex_lock(&s->s.lock);
+    res = sm_lookup_hashed(s->s.map, key, len, hash, item);
+    pthread_mutex_unlock(&s->s.lock);
+
+    return res;
+}
+
+SM_RESULT
+sm_sharded_insert_n(SM_SHARDED * sm, const char *key, size_t len,
+                    const void *data, SM_ENTRY * item)
+{
+    size_t hash;
+    SM_SHARD *s;
+    SM_RESULT res;
+
+    assert(sm);
+    assert(key);
+
+    hash = sm->hash(key, len);
+    s = shard(sm, hash);
+    pthread_mutex_lock(&s->s.lock);
+    res = sm_insert_hashed(s->s.map, key, len, hash, data, item);
+    pthread_mutex_unlock(&s->s.lock);
+
+    return res;
+}
+
+SM_RESULT
+sm_sharded_update_n(SM_SHARDED * sm, const char *key, size_t len,
+                    const void *data, SM_ENTRY * item)
+{
+    size_t hash;
+    SM_SHARD *s;
+    SM_RESULT res;
+
+    assert(sm);
+    assert(key);
+
+    hash = sm->hash(key, len);
+    s = shard(sm, hash);
+    pthread_mutex_lock(&s->s.lock);
+    res = sm_update_hashed(s->s.map, key, len, hash, data, item);
+    pthread_mutex_unlock(&s->s.lock);
+
+    return res;
+}
+
+SM_RESULT
+sm_sharded_upsert_n(SM_SHARDED * sm, const char *key, size_t len,
+                    const void *data, SM_ENTRY * item)
+{
+    size_t hash;
+    SM_SHARD *s;
+    SM_RESULT res;
+
+    assert(sm);
+    assert(key);
+
+    hash = sm->hash(key, len);
+    s = shard(sm, hash);
+    pthread_mutex_lock(&s->s.lock);
+    res = sm_upsert_hashed(s->s.map, key, len, hash, data, item);
+    pthread_mutex_unlock(&s->s.lock);
+
+    return res;
+}
+
+SM_RESULT
+sm_sharded_remove_n(SM_SHARDED * sm, const char *key, size_t len,
+                    SM_ENTRY * item)
+{
+    size_t hash;
+    SM_SHARD *s;
+    SM_RESULT res;
+
+    assert(sm);
+    assert(key);
+
+    hash = sm->hash(key, len);
+    s = shard(sm, hash);
+    pthread_mutex_lock(&s->s.lock);
+    res = sm_remove_hashed(s->s.map, key, len, hash, item);
+    pthread_mutex_unlock(&s->s.lock);
+
+    return res;
+}
+
+void
+sm_sharded_foreach(SM_SHARDED * sm, void (*action) (SM_ENTRY item, void *ctx),
+                   void *ctx)
+{
+    unsigned int i;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        sm_foreach(sm->shards[i].s.map, action, ctx);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+    }
+}
+
+void
+sm_sharded_clear(SM_SHARDED * sm)
+{
+    unsigned int i;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        sm_clear(sm->shards[i].s.map);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+    }
+}
+
+size_t
+sm_sharded_size(SM_SHARDED * sm)
+{
+    unsigned int i;
+    size_t size = 0;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        size += sm_size(sm->shards[i].s.map);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+    }
+    return size;
+}
+
+int
+sm_sharded_reserve(SM_SHARDED * sm, size_t size)
+{
+    unsigned int i;
+    int res = 0;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count && !res; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        res = sm_reserve(sm->shards[i].s.map, size / sm->count + 1);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+    }
+    return res;
+}
+
+int
+sm_sharded_shrink_to_fit(SM_SHARDED * sm)
+{
+    unsigned int i;
+    int res = 0;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count && !res; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        res = sm_shrink_to_fit(sm->shards[i].s.map);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+    }
+    return res;
+}
+
+unsigned int
+sm_sharded_shards(const SM_SHARDED * sm)
+{
+    assert(sm);
+
+    return sm->count;
+}
+
+double
+sm_sharded_load_factor(SM_SHARDED * sm)
+{
+    unsigned int i;
+    double load = 0.0;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        load += sm_load_factor(sm->shards[i].s.map);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+    }
+    return load / sm->count;
+}
+
+double
+sm_sharded_probes_mean(SM_SHARDED * sm)
+{
+    unsigned int i;
+    size_t n, size = 0;
+    double sum = 0.0;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        n = sm_size(sm->shards[i].s.map);
+        sum += (double)n * sm_probes_mean(sm->shards[i].s.map);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+        size += n;
+    }
+    return (size ? sum / (double)size : 0.0);
+}
+
+/*
+ * pooled over shards, sum of n * (var + mean^2) over size less mean^2
+ */
+double
+sm_sharded_probes_var(SM_SHARDED * sm)
+{
+    unsigned int i;
+    size_t n, size = 0;
+    double mean, sum = 0.0, squares = 0.0;
+
+    assert(sm);
+
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        n = sm_size(sm->shards[i].s.map);
+        mean = sm_probes_mean(sm->shards[i].s.map);
+        sum += (double)n * mean;
+        squares += (double)n
+            * (sm_probes_var(sm->shards[i].s.map) + mean * mean);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+        size += n;
+    }
+    if (!size) {
+        return 0.0;
+    }
+    mean = sum / (double)size;
+    return squares / (double)size - mean * mean;
+}
+
+size_t
+sm_sharded_memory_usage(SM_SHARDED * sm, SM_MEMORY * usage)
+{
+    SM_MEMORY m, s;
+    size_t size = 0;
+    unsigned int i;
+
+    assert(sm);
+
+    m.table = m.keys = 0;
+    m.map = sizeof (SM_SHARDED) + sm->count * sizeof (SM_SHARD) + SM_CACHE_LINE;
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_lock(&sm->shards[i].s.lock);
+        sm_memory_usage(sm->shards[i].s.map, &s);
+        size += sm_size(sm->shards[i].s.map);
+        pthread_mutex_unlock(&sm->shards[i].s.lock);
+        m.table += s.table;
+        m.map += s.map;
+        m.keys += s.keys;
+    }
+    m.total = m.table + m.map + m.keys;
+    m.per_key = (size ? (double)m.total / (double)size : 0.0);
+    if (usage) {
+        *usage = m;
+    }
+    return m.total;
+}
+
+void
+sm_sharded_free(SM_SHARDED * sm)
+{
+    unsigned int i;
+
+    if (!sm) {
+        return;
+    }
+    for (i = 0; i < sm->count; ++i) {
+        pthread_mutex_destroy(&sm->shards[i].s.lock);
+        sm_free(sm->shards[i].s.map);
+    }
+    sm_release(sm->alloc, sm->block);
+    sm_release(sm->alloc, sm);
+}
+
+/*
+ * high bits of the finalized key hash, the shard map reduces the raw one
+ */
+static SM_SHARD *
+shard(const SM_SHARDED * sm, size_t hash)
+{
+    SM_MIX(hash);
+    hash >>= sizeof (size_t) * CHAR_BIT - SHARD_BITS;
+    return sm->shards + (hash & (sm->count - 1));
+}
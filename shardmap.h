@@ -0,0 +1,135 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file shardmap.h
+  @brief SM_SHARDED - thread safe string map, keys are spread by hash over
+  independent STRMAP shards, each behind its own mutex
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#ifndef _SHARDMAP_H
+#define _SHARDMAP_H
+
+#include "strmap.h"
+
+typedef struct SM_SHARDED SM_SHARDED;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  @brief Create a sharded map which can contain at least `size` keys;
+  `shards` is rounded up to a power of two (0 - 16, at most 65536), every
+  shard is a map with options `opts` (may be NULL) and grows on its own;
+  `value_size` must be 0, a value pointer would outlive the shard lock
+  @return map or NULL with errno set to ENOMEM or EINVAL
+*/
+    SM_SHARDED *sm_sharded_create(size_t size, unsigned int shards,
+                                  const SM_OPTIONS * opts);
+
+/**
+  @brief sm_* counterparts, the shard of the key is locked for the call;
+  `item` is a copy taken under the lock, with SM_INLINE_KEYS its key may
+  point into a table other threads modify
+*/
+    SM_RESULT sm_sharded_lookup(SM_SHARDED * sm, const char *key,
+                                SM_ENTRY * item);
+    SM_RESULT sm_sharded_insert(SM_SHARDED * sm, const char *key,
+                                const void *data, SM_ENTRY * item);
+    SM_RESULT sm_sharded_update(SM_SHARDED * sm, const char *key,
+                                const void *data, SM_ENTRY * item);
+    SM_RESULT sm_sharded_upsert(SM_SHARDED * sm, const char *key,
+                                const void *data, SM_ENTRY * item);
+    SM_RESULT sm_sharded_remove(SM_SHARDED * sm, const char *key,
+                                SM_ENTRY * item);
+
+    SM_RESULT sm_sharded_lookup_n(SM_SHARDED * sm, const char *key,
+                                  size_t len, SM_ENTRY * item);
+    SM_RESULT sm_sharded_insert_n(SM_SHARDED * sm, const char *key,
+                                  size_t len, const void *data,
+                                  SM_ENTRY * item);
+    SM_RESULT sm_sharded_update_n(SM_SHARDED * sm, const char *key,
+                                  size_t len, const void *data,
+                                  SM_ENTRY * item);
+    SM_RESULT sm_sharded_upsert_n(SM_SHARDED * sm, const char *key,
+                                  size_t len, const void *data,
+                                  SM_ENTRY * item);
+    SM_RESULT sm_sharded_remove_n(SM_SHARDED * sm, const char *key,
+                                  size_t len, SM_ENTRY * item);
+
+/**
+  @brief For each callback, shards are locked one at a time
+*/
+    void sm_sharded_foreach(SM_SHARDED * sm,
+                            void (*action) (SM_ENTRY item, void *ctx),
+                            void *ctx);
+
+/**
+  @brief Remove all keys
+*/
+    void sm_sharded_clear(SM_SHARDED * sm);
+
+/**
+  @brief Number of keys, shards are summed one at a time
+*/
+    size_t sm_sharded_size(SM_SHARDED * sm);
+
+/**
+  @brief Reserve `size / shards` keys in every shard, or shrink each one
+  @return 0 on success, -1 with errno set to ENOMEM otherwise
+*/
+    int sm_sharded_reserve(SM_SHARDED * sm, size_t size);
+    int sm_sharded_shrink_to_fit(SM_SHARDED * sm);
+
+    unsigned int sm_sharded_shards(const SM_SHARDED * sm);
+    double sm_sharded_load_factor(SM_SHARDED * sm);
+
+/**
+  @brief sm_probes_mean and sm_probes_var over the keys of all shards
+*/
+    double sm_sharded_probes_mean(SM_SHARDED * sm);
+    double sm_sharded_probes_var(SM_SHARDED * sm);
+
+/**
+  @brief Bytes allocated for the map and its shards, `usage` may be NULL
+  @return total bytes
+*/
+    size_t sm_sharded_memory_usage(SM_SHARDED * sm, SM_MEMORY * usage);
+
+/**
+  @brief Free all shards, no other thread may use the map
+*/
+    void sm_sharded_free(SM_SHARDED * sm);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -33,59 +33,395 @@
   @license The Unlicense
 */
 
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE         /* MAP_ANONYMOUS, madvise */
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#if defined(MAP_ANONYMOUS) && defined(MADV_HUGEPAGE)
+#define HUGE_PAGES
+#endif
+#endif
+
+/* sm_build worker threads */
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#if defined(_POSIX_THREADS) && _POSIX_THREADS > 0
+#include <pthread.h>
+#define THREADS
+#endif
+#endif
+
+#if ULONG_MAX > 0xffffffffUL \
+    && (defined(__SSE4_2__) || (defined(__GNUC__) && defined(__x86_64__)))
+#include <nmmintrin.h>
+#define CRC32C_SSE42
+#endif
+
+/* SM_SEQLOCK sequence and fences */
+#if defined(__GNUC__)
+#define SEQLOCK
+#define SEQ_LOAD(p, order) __atomic_load_n((p), (order))
+#define SEQ_STORE(p, v, order) __atomic_store_n((p), (v), (order))
+#define SEQ_FENCE(order) __atomic_thread_fence(order)
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GROUP 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GROUP 16
+#define GROUP_SSE2
+#else
+#define GROUP 16
+#endif
 
 #include "strmap.h"
+#include "strmap_int.h"
 
 static const size_t MIN_SIZE = 6;
 static const size_t MAX_SIZE = (~((size_t)0)) >> 1;
-static const double LOAD_FACTOR = 0.7;
-static const double GROW_FACTOR = 1.5;
+static const double LOAD_FACTOR = SM_LOAD_FACTOR;
+static const double GROW_FACTOR = SM_GROW_FACTOR;
+
+/* SM_INLINE_KEYS slot key bytes, last one is the key tag */
+#define INLINE_KEY 16
+#define INLINE_TAG (INLINE_KEY - 1)
+/* key tag: 0 - empty slot, short key length + 1 or LONG_KEY */
+#define LONG_KEY 0xff
+/* long key: pointer, then key length in the rest bytes before tag */
+#define LONG_LEN (sizeof (const char *))
+
+typedef struct SM_ISLOT {
+    char key[INLINE_KEY];       /* short key or pointer and length */
+    const void *data;
+    size_t hash;
+} SM_ISLOT;
+
+/* SM_COMPACT slot, key is a reference into the map arena */
+typedef struct SM_CSLOT {
+    unsigned int ref;           /* chunk index + 1 << 16 | offset, 0 - empty */
+    unsigned int hash;          /* low 32 bits of hash */
+    const void *data;
+} SM_CSLOT;
+
+/* SM_KEYS_ONLY slot, no data, 32 bit hash and length */
+typedef struct SM_KSLOT {
+    const char *key;
+    unsigned int hash;          /* low 32 bits of hash */
+    unsigned int len;
+} SM_KSLOT;
+
+/* SM_COMPACT: key copy is preceded by its reference and length */
+#define KEY_HEADER (2 * sizeof (unsigned int))
+#define MAX_CHUNKS 0xffff
+
+/* SM_DIRTY_LOG: logged slots per table slot, full clear past it */
+#define DIRTY_RATIO 16
+
+/* value array alignment */
+#define VALUE_ALIGN 16
+
+/* SM_INPLACE_GROW: spare slots after the table to swap entries */
+#define SPARE_SLOTS 2
+
+/* SM_HUGE_PAGES: tables of at least huge page size are mapped */
+#define HUGE_PAGE ((size_t)2 << 20)
+
+/* SM_OWN_KEYS: bump allocated key chunks */
+#define ARENA_CHUNK 65536
+
+/* SM_SEQLOCK: table or keys a lookup may still read */
+typedef struct SM_RETIRED {
+    struct SM_RETIRED *next;
+    void *table;                /* NULL - keys only */
+    size_t bytes;
+    size_t mapped;
+    struct SM_ARENA *arena;
+} SM_RETIRED;
+
+typedef struct SM_ARENA {
+    char **chunks;              /* chunk directory */
+    size_t count;               /* chunks in use */
+    size_t slots;               /* directory size */
+    char *top;                  /* free space of the current chunk */
+    size_t left;
+    size_t current;             /* chunk of top */
+    size_t last;                /* chunk of the last block */
+    size_t bytes;               /* chunk bytes */
+} SM_ARENA;
 
 struct STRMAP {
     size_t capacity;            /* number of allocated entries */
     size_t size;                /* number of keys in map */
     size_t msize;               /* max size */
     SM_ENTRY *ht;
+    SM_ISLOT *it;               /* SM_INLINE_KEYS: slots instead of ht */
+    SM_CSLOT *ct;               /* SM_COMPACT: slots instead of ht */
+    SM_KSLOT *kt;               /* SM_KEYS_ONLY: slots instead of ht */
+    unsigned int *tags;         /* SM_SPLIT: hash tags, 0 - empty slot */
+    unsigned char *ctrl;        /* SM_SWISS: control bytes */
+    unsigned char *dist;        /* SM_ROBIN_HOOD: probe distances,
+                                   UCHAR_MAX - not cached */
+    size_t deleted;             /* SM_SWISS: number of tombstones */
+    SM_OPTIONS opt;
+    STRMAP *old;                /* SM_INCREMENTAL: table being migrated */
+    size_t cursor;              /* SM_INCREMENTAL: next old slot to move */
+    SM_ARENA *arena;            /* SM_OWN_KEYS: key copies, NULL if none */
+    size_t mapped;              /* SM_HUGE_PAGES: table bytes mapped, 0 if
+                                   allocated */
+    size_t *dirty;              /* SM_DIRTY_LOG: slots written since clear */
+    size_t ndirty;
+    size_t maxdirty;            /* log size, log full - clear all slots */
+    char *values;               /* value_size: values parallel to slots */
+    unsigned long seq;          /* SM_SEQLOCK: odd while the writer changes
+                                   the map */
+    SM_RETIRED *retired;        /* SM_SEQLOCK: freed by sm_reclaim */
 };
 
-static const SM_ENTRY EMPTY = { 0, 0, 0 };
+/* sm_build: at most BUILD_THREADS threads, BUILD_KEYS keys or more each */
+#define BUILD_THREADS 64
+#define BUILD_KEYS 4096
 
-static SM_ENTRY *find(const STRMAP * sm, const char *key, size_t hash);
-static void compress(STRMAP * sm, SM_ENTRY * entry);
+typedef struct SM_BUILD {
+    STRMAP *sm;
+    const char *const *keys;
+    const void *const *datas;
+    size_t n;
+    unsigned int threads;       /* threads, table regions */
+    int regions;                /* layout filled region by region */
+    size_t width;               /* slots per region */
+    size_t *lens;
+    size_t *hashes;
+    size_t *order;              /* key indexes grouped by home region */
+    size_t *counts;             /* thread rows of region counts, then of
+                                   scatter offsets */
+    size_t stride;              /* counts row length */
+    size_t *bounds;             /* region r: order[bounds[r], bounds[r + 1]) */
+} SM_BUILD;
+
+typedef struct SM_BUILDER {
+    SM_BUILD *b;
+    void (*step) (struct SM_BUILDER * w);
+    unsigned int id;
+    size_t placed;              /* keys stored in the region */
+    size_t spilled;             /* keys left for the calling thread */
+} SM_BUILDER;
+
+/* SM_INCREMENTAL: old table slots moved per modifying operation */
+#define MIGRATE_SLOTS 8
+
+/* SM_SWISS control bytes, full slot is 0x80 | 7 bit fingerprint */
+#define CTRL_EMPTY 0x00
+#define CTRL_DELETED 0x01
+#define CTRL_FULL 0x80
+
+static const SM_ENTRY EMPTY = { 0, 0, 0, 0 };
+
+static int find(const STRMAP * sm, const char *key, size_t len, size_t hash,
+                size_t * slot);
+static int find_split(const STRMAP * sm, const char *key, size_t len,
+                      size_t hash, size_t * slot);
+static int find_swiss(const STRMAP * sm, const char *key, size_t len,
+                      size_t hash, size_t * slot);
+static int find_inline(const STRMAP * sm, const char *key, size_t len,
+                       size_t hash, size_t * slot);
+static int find_robin_hood(const STRMAP * sm, const char *key, size_t len,
+                           size_t hash, size_t * slot);
+static int equal(const STRMAP * sm, size_t i, const char *key, size_t len,
+                 size_t hash);
+static size_t long_len(const SM_ISLOT * s);
+#ifdef SEQLOCK
+static SM_RESULT lookup_seq(const STRMAP * sm, const char *key, size_t len,
+                            size_t hash, SM_ENTRY * item);
+static int find_seq(const STRMAP * sm, const char *key, size_t len,
+                    size_t hash, size_t * slot, const unsigned long *seq,
+                    unsigned long start);
+#endif
+static void clear(STRMAP * sm);
+static int place(STRMAP * sm, const char *key, size_t len, const void *data,
+                 size_t hash);
+static void run(SM_BUILD * b, SM_BUILDER * w,
+                void (*step) (SM_BUILDER * w));
+#ifdef THREADS
+static void *build_thread(void *arg);
+#endif
+static void hash_keys(SM_BUILDER * w);
+static void scatter_keys(SM_BUILDER * w);
+static void fill_region(SM_BUILDER * w);
+static void begin_write(STRMAP * sm);
+static void end_write(STRMAP * sm);
+static void set_entry(STRMAP * sm, size_t i, const SM_ENTRY * entry);
+static void set_table(STRMAP * sm, SM_ENTRY * ht, size_t capacity);
+static int retire(STRMAP * sm, int table);
+static int drop_table(STRMAP * sm);
+static void *table_base(const STRMAP * sm);
+static int find_keys(const STRMAP * sm, const char *key, size_t len,
+                     size_t hash, size_t * slot);
+static int find_compact(const STRMAP * sm, const char *key, size_t len,
+                        size_t hash, size_t * slot);
+static const char *compact_key(const STRMAP * sm, unsigned int ref);
+static size_t compact_len(const char *key);
+static size_t key_hash(const STRMAP * sm, const char *key, size_t len);
+static size_t map_hash(const STRMAP * sm, size_t hash);
+static void free_old(STRMAP * sm);
+static int used(const STRMAP * sm, size_t i);
+static size_t stored_hash(const STRMAP * sm, size_t i);
+static void view(const STRMAP * sm, size_t i, SM_ENTRY * item);
+static void set_data(STRMAP * sm, size_t i, const void *data);
+static void put(STRMAP * sm, size_t i, const char *key, size_t len,
+                const void *data, size_t hash);
+static void move(STRMAP * sm, size_t to, size_t from);
+static void erase(STRMAP * sm, size_t i);
+static void mark(STRMAP * sm, size_t i);
+static void reset(STRMAP * sm, size_t i);
+static void displace(STRMAP * sm, size_t i);
+static void compress(STRMAP * sm, size_t i);
 STRMAP *grow(STRMAP * sm);
-static size_t distance(const SM_ENTRY * from, const SM_ENTRY * to, size_t range);
-static size_t POSITION(size_t x, size_t range);
+static STRMAP *rehash(STRMAP * sm, size_t size);
+static STRMAP *transplant(const STRMAP * sm, size_t size, int copy);
+static STRMAP *resize(STRMAP * sm, size_t size);
+static STRMAP *expand(STRMAP * sm, size_t size);
+static void redistribute(STRMAP * sm, size_t old, unsigned char *done);
+static size_t layout(const SM_OPTIONS * opt, size_t capacity,
+                     size_t * values, size_t * log);
+static char *value(const STRMAP * sm, size_t i);
+static void store(STRMAP * sm, size_t i, const void *data);
+static size_t slot_size(unsigned int flags);
+static void adopt(STRMAP * sm, STRMAP * map);
+static void shrink(STRMAP * sm);
+static const char *own(STRMAP * sm, const char *key, size_t len);
+static char *arena_alloc(STRMAP * sm, size_t n);
+static void arena_release(const STRMAP * sm, SM_ARENA * arena);
+static void *table_alloc(const SM_ALLOCATOR * mem, unsigned int flags,
+                         size_t size, size_t * mapped);
+static void table_free(const SM_ALLOCATOR * mem, void *table, size_t mapped);
+static void release_table(const STRMAP * sm);
+static void *allocate(const STRMAP * sm, size_t size);
+static void release(const STRMAP * sm, void *ptr);
+static void *std_alloc(void *ctx, size_t size);
+static void *std_zalloc(void *ctx, size_t size);
+static void *std_realloc(void *ctx, void *ptr, size_t size);
+static void std_free(void *ctx, void *ptr);
+static STRMAP *locate(STRMAP * sm, const char *key, size_t len, size_t hash,
+                      size_t * slot);
+static void migrate(STRMAP * sm, size_t n);
+static void transfer(STRMAP * sm, size_t i);
+static void evacuate(STRMAP * sm, size_t i);
+static size_t probes(const STRMAP * sm, size_t i);
+static void set_probes(STRMAP * sm, size_t i, size_t n);
+static size_t distance(size_t from, size_t to, size_t range);
+static size_t POSITION(const STRMAP * sm, size_t hash);
 static size_t adjust(size_t x);
+static unsigned int TAG(size_t hash);
+static size_t MIX(size_t hash);
+static unsigned int MATCH(const unsigned char *ctrl, unsigned char c);
+static unsigned int AVAILABLE(const unsigned char *ctrl);
+static unsigned int LOWEST(unsigned int bits);
+
+static const SM_ALLOCATOR STD_ALLOCATOR =
+    { std_alloc, std_zalloc, std_realloc, std_free, 0 };
 
 STRMAP *
 sm_create(size_t size)
 {
-    SM_ENTRY *ht;
-    STRMAP *sm;
-    size_t capacity, msize;
+    return sm_create_ex(size, 0);
+}
 
-    msize = (size < MIN_SIZE ? MIN_SIZE : size);
-    msize = (msize > MAX_SIZE ? MAX_SIZE : msize);
-    capacity = (size_t)(msize / LOAD_FACTOR);
-    capacity = adjust(capacity);
+STRMAP *
+sm_create_ex(size_t size, const SM_OPTIONS * opts)
+{
+    static const SM_OPTIONS DEFAULTS = { SM_DEFAULT, 0, 0, 0, 0 };
+    static const unsigned int FLAGS =
+        SM_SPLIT | SM_SWISS | SM_ROBIN_HOOD | SM_POW2 | SM_INLINE_KEYS
+        | SM_INCREMENTAL | SM_OWN_KEYS | SM_HUGE_PAGES | SM_COMPACT
+        | SM_DIRTY_LOG | SM_INPLACE_GROW | SM_KEYS_ONLY | SM_SEQLOCK;
+#ifdef SEQLOCK
+    static const unsigned int SEQLOCK_FLAGS =
+        SM_SEQLOCK | SM_POW2 | SM_OWN_KEYS | SM_HUGE_PAGES | SM_DIRTY_LOG;
+#else
+    static const unsigned int SEQLOCK_FLAGS = 0;
+#endif
+    const SM_ALLOCATOR *mem;
+    void *ht;
+    STRMAP *sm;
+    size_t capacity, msize, mapped, bytes, values, log;
+    unsigned int flags;
 
-    assert(msize < capacity);
+    if (!opts) {
+        opts = &DEFAULTS;
+    }
+    flags = opts->flags;
+    mem = (opts->alloc ? opts->alloc : &STD_ALLOCATOR);
+    if ((flags & ~FLAGS)
+        || ((flags & SM_SWISS) && (flags & (SM_SPLIT | SM_ROBIN_HOOD | SM_INLINE_KEYS)))
+        || ((flags & SM_SPLIT) && (flags & (SM_ROBIN_HOOD | SM_INLINE_KEYS)))
+        || ((flags & SM_COMPACT) && ((flags & (SM_SPLIT | SM_SWISS | SM_INLINE_KEYS))
+                                     || !(flags & SM_OWN_KEYS)))
+        || ((flags & SM_INPLACE_GROW)
+            && (flags & (SM_SPLIT | SM_SWISS | SM_ROBIN_HOOD | SM_INCREMENTAL)))
+        || ((flags & SM_KEYS_ONLY)
+            && ((flags & (SM_SPLIT | SM_SWISS | SM_INLINE_KEYS | SM_COMPACT))
+                || opts->value_size))
+        || ((flags & SM_SEQLOCK)
+            && ((flags & ~SEQLOCK_FLAGS) || opts->value_size))) {
+        errno = EINVAL;
+        return 0;
+    }
 
-    if (!(ht = (SM_ENTRY *) calloc(capacity, sizeof (SM_ENTRY)))) {
+    if (!sm_dimension(flags, size, &msize, &capacity)
+        || !(bytes = layout(opts, capacity, &values, &log))
+        || !(ht = table_alloc(mem, flags, bytes, &mapped))) {
         errno = ENOMEM;
         return 0;
     }
-    if ((sm = (STRMAP *) calloc(1, sizeof (STRMAP)))) {
+    if ((sm = (STRMAP *) mem->zalloc(mem->ctx, sizeof (STRMAP)))) {
         sm->size = 0;
         sm->msize = msize;
         sm->capacity = capacity;
-        sm->ht = ht;
+        sm->ht = 0;
+        sm->it = 0;
+        sm->ct = 0;
+        sm->kt = 0;
+        if (flags & SM_INLINE_KEYS) {
+            sm->it = (SM_ISLOT *) ht;
+        }
+        else if (flags & SM_COMPACT) {
+            sm->ct = (SM_CSLOT *) ht;
+        }
+        else if (flags & SM_KEYS_ONLY) {
+            sm->kt = (SM_KSLOT *) ht;
+        }
+        else {
+            sm->ht = (SM_ENTRY *) ht;
+        }
+        sm->tags = (flags & SM_SPLIT ? (unsigned int *)(sm->ht + capacity) : 0);
+        sm->ctrl = (flags & SM_SWISS ? (unsigned char *)(sm->ht + capacity) : 0);
+        sm->dist = (flags & SM_ROBIN_HOOD
+                    ? (unsigned char *)ht + capacity * slot_size(flags) : 0);
+        sm->deleted = 0;
+        sm->opt = *opts;
+        if (!sm->opt.hash) {
+            sm->opt.hash = poly_hashn;
+        }
+        sm->opt.alloc = mem;
+        sm->mapped = mapped;
+        sm->maxdirty = (flags & SM_DIRTY_LOG ? capacity / DIRTY_RATIO + 1 : 0);
+        sm->dirty = (sm->maxdirty ? (size_t *) ht + log : 0);
+        sm->ndirty = 0;
+        sm->values = (opts->value_size ? (char *) ht + values : 0);
+        sm->seq = 0;
+        sm->retired = 0;
     } else {
-        free(ht);
+        table_free(mem, ht, mapped);
         errno = ENOMEM;
     }
 
@@ -95,58 +431,253 @@ sm_create(size_t size)
 STRMAP *
 sm_create_from(const STRMAP * sm, size_t size)
 {
-    SM_ENTRY *item, *entry, *stop;
+    assert(sm);
+
+    return transplant(sm, size, 1);
+}
+
+/*
+ * new map for at least `size` keys holding those of `sm`; `copy` -
+ * SM_OWN_KEYS keys are copied into the new arena, otherwise both maps
+ * share the arena of `sm` and the caller clears one of the two
+ */
+STRMAP *
+transplant(const STRMAP * sm, size_t size, int copy)
+{
+    const STRMAP *src;
+    SM_ENTRY item;
     STRMAP *map;
+    size_t i, slot;
 
-    assert(sm);
-    
     size = (size < sm->size ? sm->size : size);
-    map = sm_create(size);
+    map = sm_create_ex(size, &sm->opt);
     if (!map) {
         return 0;
     }
+    if (!copy) {
+        /* SM_COMPACT references resolve through the map arena */
+        map->arena = sm->arena;
+    }
 
-    stop = sm->ht + sm->capacity;
-    for (item = sm->ht; item != stop; ++item) {
-        if (item->key) {
-            entry = find(map, item->key, item->hash);
-            *entry = *item;
-            ++(map->size);
+    for (src = sm; src; src = src->old) {
+        for (i = 0; i < src->capacity; ++i) {
+            if (used(src, i)) {
+                view(src, i, &item);
+                if (copy && !(item.key = own(map, item.key, item.len))) {
+                    sm_free(map);
+                    errno = ENOMEM;
+                    return 0;
+                }
+                find(map, item.key, item.len, item.hash, &slot);
+                put(map, slot, item.key, item.len, item.data, item.hash);
+                ++(map->size);
+            }
         }
     }
     assert(map->size == sm->size);
     return map;
 }
 
+STRMAP *
+sm_build(const char *const *keys, const void *const *datas, size_t n,
+         unsigned int nthreads)
+{
+    return sm_build_ex(keys, datas, n, nthreads, 0);
+}
+
+/*
+ * hash keys in parallel, group them by the region of the table their
+ * home slot falls in and let each thread probe inside its own region;
+ * keys whose run reaches the region end, wrapping runs included, are
+ * stored by the calling thread afterwards
+ */
+STRMAP *
+sm_build_ex(const char *const *keys, const void *const *datas, size_t n,
+            unsigned int nthreads, const SM_OPTIONS * opts)
+{
+    SM_BUILDER workers[BUILD_THREADS];
+    SM_BUILD b;
+    STRMAP *sm;
+    size_t *scratch;
+    size_t i, k, r, t, c, len, words, sum;
+    int res = 1;
+
+    assert(keys || !n);
+
+    if (!(sm = sm_create_ex(n, opts))) {
+        return 0;
+    }
+    b.threads = (nthreads < BUILD_THREADS ? nthreads : BUILD_THREADS);
+    if (b.threads > n / BUILD_KEYS) {
+        b.threads = (unsigned int)(n / BUILD_KEYS);
+    }
+    if (b.threads < 2) {
+        for (i = 0; i < n && res >= 0; ++i) {
+            len = strlen(keys[i]);
+            res = place(sm, keys[i], len, datas ? datas[i] : 0,
+                        key_hash(sm, keys[i], len));
+        }
+    }
+    else {
+        b.sm = sm;
+        b.keys = keys;
+        b.datas = datas;
+        b.n = n;
+        b.regions = !(sm->opt.flags & (SM_SWISS | SM_ROBIN_HOOD | SM_OWN_KEYS
+                                       | SM_COMPACT | SM_DIRTY_LOG));
+        b.width = (sm->capacity + b.threads - 1) / b.threads;
+        /* counts rows do not share cache lines */
+        b.stride = (b.threads + 7u) / 8u * 8u;
+        words = b.threads * b.stride + b.threads + 1;
+        if (n > (((size_t)-1) / sizeof (size_t) - words) / 3
+            || !(scratch = (size_t *) allocate(sm, (3 * n + words)
+                                                   * sizeof (size_t)))) {
+            sm_free(sm);
+            errno = ENOMEM;
+            return 0;
+        }
+        b.lens = scratch;
+        b.hashes = b.lens + n;
+        b.order = b.hashes + n;
+        b.counts = b.order + n;
+        b.bounds = b.counts + b.threads * b.stride;
+        memset(b.counts, 0, b.threads * b.stride * sizeof (size_t));
+        for (t = 0; t < b.threads; ++t) {
+            workers[t].placed = workers[t].spilled = 0;
+        }
+
+        run(&b, workers, hash_keys);
+        if (b.regions) {
+            /* thread t writes its region r keys after those of threads
+               before it, so each region keeps the input order */
+            for (sum = 0, r = 0; r < b.threads; ++r) {
+                b.bounds[r] = sum;
+                for (t = 0; t < b.threads; ++t) {
+                    c = b.counts[t * b.stride + r];
+                    b.counts[t * b.stride + r] = sum;
+                    sum += c;
+                }
+            }
+            b.bounds[b.threads] = sum;
+            run(&b, workers, scatter_keys);
+            run(&b, workers, fill_region);
+            for (t = 0; t < b.threads; ++t) {
+                sm->size += workers[t].placed;
+            }
+            for (r = 0; r < b.threads && res >= 0; ++r) {
+                for (k = b.bounds[r];
+                     k < b.bounds[r] + workers[r].spilled && res >= 0; ++k) {
+                    i = b.order[k];
+                    res = place(sm, keys[i], b.lens[i],
+                                datas ? datas[i] : 0, b.hashes[i]);
+                }
+            }
+        }
+        else {
+            for (i = 0; i < n && res >= 0; ++i) {
+                res = place(sm, keys[i], b.lens[i], datas ? datas[i] : 0,
+                            b.hashes[i]);
+            }
+        }
+        release(sm, scratch);
+    }
+    if (res < 0) {
+        sm_free(sm);
+        errno = ENOMEM;
+        return 0;
+    }
+
+    return sm;
+}
+
 SM_RESULT
 sm_insert(STRMAP * sm, const char *key, const void *data, SM_ENTRY * item)
 {
-    SM_ENTRY *entry;
-    size_t hash;
+    assert(key);
+
+    return sm_insert_n(sm, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_update(STRMAP * sm, const char *key, const void *data, SM_ENTRY * item)
+{
+    assert(key);
+
+    return sm_update_n(sm, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_upsert(STRMAP * sm, const char *key, const void *data, SM_ENTRY * item)
+{
+    assert(key);
+
+    return sm_upsert_n(sm, key, strlen(key), data, item);
+}
+
+SM_RESULT
+sm_lookup(const STRMAP * sm, const char *key, SM_ENTRY * item)
+{
+    assert(key);
+
+    return sm_lookup_n(sm, key, strlen(key), item);
+}
+
+SM_RESULT
+sm_remove(STRMAP * sm, const char *key, SM_ENTRY * item)
+{
+    assert(key);
+
+    return sm_remove_n(sm, key, strlen(key), item);
+}
+
+SM_RESULT
+sm_insert_n(STRMAP * sm, const char *key, size_t len, const void *data,
+            SM_ENTRY * item)
+{
+    assert(sm);
+    assert(key);
+
+    return sm_insert_hashed(sm, key, len, sm->opt.hash(key, len), data, item);
+}
+
+SM_RESULT
+sm_insert_hashed(STRMAP * sm, const char *key, size_t len, size_t hash,
+                 const void *data, SM_ENTRY * item)
+{
+    STRMAP *map;
+    size_t i;
 
     assert(sm);
     assert(key);
 
-    hash = poly_hashs(key);
-    entry = find(sm, key, hash);
-    if (!(entry->key)) {
-        if (sm->size == sm->msize) {
-            if (grow(sm)) {
-                entry = find(sm, key, hash);
+    if (sm->old) {
+        migrate(sm, MIGRATE_SLOTS);
+    }
+    hash = map_hash(sm, hash);
+    if (!(map = locate(sm, key, len, hash, &i))) {
+        if (sm->size + sm->deleted == sm->msize) {
+            begin_write(sm);
+            map = grow(sm);
+            end_write(sm);
+            if (map) {
+                find(sm, key, len, hash, &i);
             }
             else {
                 return SM_MAP_FULL;
             }
         }
+        if (!(key = own(sm, key, len))) {
+            return SM_MAP_FULL;
+        }
         
-        entry->key = key;
-        entry->data = data;
-        entry->hash = hash;
+        begin_write(sm);
+        put(sm, i, key, len, data, hash);
+        ++(sm->size);
+        end_write(sm);
 
         if (item) {
-            *item = *entry;            
+            view(sm, i, item);
         }
-        ++(sm->size);
 
         return SM_INSERTED;
     }
@@ -155,21 +686,36 @@ sm_insert(STRMAP * sm, const char *key, const void *data, SM_ENTRY * item)
 }
 
 SM_RESULT
-sm_update(STRMAP * sm, const char *key, const void *data, SM_ENTRY * item)
+sm_update_n(STRMAP * sm, const char *key, size_t len, const void *data,
+            SM_ENTRY * item)
 {
-    SM_ENTRY *entry;
-    size_t hash;
+    assert(sm);
+    assert(key);
+
+    return sm_update_hashed(sm, key, len, sm->opt.hash(key, len), data, item);
+}
+
+SM_RESULT
+sm_update_hashed(STRMAP * sm, const char *key, size_t len, size_t hash,
+                 const void *data, SM_ENTRY * item)
+{
+    STRMAP *map;
+    size_t i;
 
     assert(sm);
     assert(key);
 
-    hash = poly_hashs(key);
-    entry = find(sm, key, hash);
-    if (entry->key) {
+    if (sm->old) {
+        migrate(sm, MIGRATE_SLOTS);
+    }
+    hash = map_hash(sm, hash);
+    if ((map = locate(sm, key, len, hash, &i))) {
         if (item) {
-            *item = *entry;            
+            view(map, i, item);
         }
-        entry->data = data;
+        begin_write(sm);
+        set_data(map, i, data);
+        end_write(sm);
         return SM_UPDATED;
     }
 
@@ -177,57 +723,96 @@ sm_update(STRMAP * sm, const char *key, const void *data, SM_ENTRY * item)
 }
 
 SM_RESULT
-sm_upsert(STRMAP * sm, const char *key, const void *data, SM_ENTRY * item)
+sm_upsert_n(STRMAP * sm, const char *key, size_t len, const void *data,
+            SM_ENTRY * item)
 {
-    SM_ENTRY *entry;
-    size_t hash;
+    assert(sm);
+    assert(key);
+
+    return sm_upsert_hashed(sm, key, len, sm->opt.hash(key, len), data, item);
+}
+
+SM_RESULT
+sm_upsert_hashed(STRMAP * sm, const char *key, size_t len, size_t hash,
+                 const void *data, SM_ENTRY * item)
+{
+    STRMAP *map;
+    size_t i;
 
     assert(sm);
     assert(key);
 
-    hash = poly_hashs(key);
-    entry = find(sm, key, hash);
-    if (entry->key) {
+    if (sm->old) {
+        migrate(sm, MIGRATE_SLOTS);
+    }
+    hash = map_hash(sm, hash);
+    if ((map = locate(sm, key, len, hash, &i))) {
         if (item) {
-            *item = *entry;            
+            view(map, i, item);
         }
-        entry->data = data;
+        begin_write(sm);
+        set_data(map, i, data);
+        end_write(sm);
         return SM_UPDATED;
     }
-    if (sm->size == sm->msize) {
-        if (grow(sm)) {
-            entry = find(sm, key, hash);
+    if (sm->size + sm->deleted == sm->msize) {
+        begin_write(sm);
+        map = grow(sm);
+        end_write(sm);
+        if (map) {
+            find(sm, key, len, hash, &i);
         }
         else {
             return SM_MAP_FULL;
         }
     }
-    entry->key = key;
-    entry->data = data;
-    entry->hash = hash;
-    if (item) {
-        *item = *entry;            
+    if (!(key = own(sm, key, len))) {
+        return SM_MAP_FULL;
     }
+    begin_write(sm);
+    put(sm, i, key, len, data, hash);
     ++(sm->size);
+    end_write(sm);
+    if (item) {
+        view(sm, i, item);
+    }
 
     return SM_INSERTED;
 }
 
 SM_RESULT
-sm_lookup(const STRMAP * sm, const char *key, SM_ENTRY * item)
+sm_lookup_n(const STRMAP * sm, const char *key, size_t len, SM_ENTRY * item)
 {
-    SM_ENTRY *entry;
-    size_t hash;
-
     assert(sm);
     assert(key);
 
-    hash = poly_hashs(key);
-    entry = find(sm, key, hash);
+    return sm_lookup_hashed(sm, key, len, sm->opt.hash(key, len), item);
+}
+
+SM_RESULT
+sm_lookup_hashed(const STRMAP * sm, const char *key, size_t len, size_t hash,
+                 SM_ENTRY * item)
+{
+    size_t i;
+
+    assert(sm);
+    assert(key);
 
-    if (entry->key) {
+    hash = map_hash(sm, hash);
+#ifdef SEQLOCK
+    if (sm->opt.flags & SM_SEQLOCK) {
+        return lookup_seq(sm, key, len, hash, item);
+    }
+#endif
+    if (find(sm, key, len, hash, &i)) {
+        if (item) {
+            view(sm, i, item);
+        }
+        return SM_FOUND;
+    }
+    if (sm->old && find(sm->old, key, len, hash, &i)) {
         if (item) {
-            *item = *entry;            
+            view(sm->old, i, item);
         }
         return SM_FOUND;
     }
@@ -236,40 +821,133 @@ sm_lookup(const STRMAP * sm, const char *key, SM_ENTRY * item)
 }
 
 SM_RESULT
-sm_remove(STRMAP * sm, const char *key, SM_ENTRY * item)
+sm_remove_n(STRMAP * sm, const char *key, size_t len, SM_ENTRY * item)
 {
-    SM_ENTRY *entry;
-    size_t hash;
-
     assert(sm);
     assert(key);
 
-    hash = poly_hashs(key);
-    entry = find(sm, key, hash);
+    return sm_remove_hashed(sm, key, len, sm->opt.hash(key, len), item);
+}
+
+SM_RESULT
+sm_remove_hashed(STRMAP * sm, const char *key, size_t len, size_t hash,
+                 SM_ENTRY * item)
+{
+    STRMAP *map;
+    size_t i;
+
+    assert(sm);
+    assert(key);
 
-    if (entry->key) {
+    if (sm->old) {
+        migrate(sm, MIGRATE_SLOTS);
+    }
+    hash = map_hash(sm, hash);
+    if ((map = locate(sm, key, len, hash, &i))) {
         if (item) {
-            *item = *entry;            
+            view(map, i, item);
+            if ((map->it || sm->arena) && item->key != key) {
+                /* stored copy may be overwritten or released */
+                item->key = key;
+            }
+            if (sm->values) {
+                item->data = 0;
+            }
         }
-        *entry = EMPTY;
+        begin_write(sm);
+        erase(map, i);
         --(sm->size);
-        compress(sm, entry);
+        if (map != sm) {
+            /* old table: move out the rest of the run instead of shift */
+            --(map->size);
+            evacuate(sm, i);
+        }
+        else if (!sm->ctrl) {
+            compress(sm, i);
+        }
+        if (sm->opt.shrink && sm->size * 100 < sm->opt.shrink * sm->msize) {
+            shrink(sm);
+        }
+        end_write(sm);
         return SM_REMOVED;
     }
 
     return SM_NOT_FOUND;
 }
 
+void *
+sm_value(const STRMAP * sm, const char *key)
+{
+    return sm_value_n(sm, key, strlen(key));
+}
+
+void *
+sm_value_n(const STRMAP * sm, const char *key, size_t len)
+{
+    SM_ENTRY item;
+
+    assert(sm);
+    assert(sm->opt.value_size);
+
+    if (sm_lookup_n(sm, key, len, &item) == SM_FOUND) {
+        return (void *)item.data;
+    }
+    return 0;
+}
+
+void *
+sm_emplace(STRMAP * sm, const char *key, SM_RESULT * result)
+{
+    return sm_emplace_n(sm, key, strlen(key), result);
+}
+
+void *
+sm_emplace_n(STRMAP * sm, const char *key, size_t len, SM_RESULT * result)
+{
+    STRMAP *map;
+    size_t hash, i;
+    SM_RESULT res = SM_FOUND;
+
+    assert(sm);
+    assert(key);
+    assert(sm->opt.value_size);
+
+    if (sm->old) {
+        migrate(sm, MIGRATE_SLOTS);
+    }
+    hash = key_hash(sm, key, len);
+    if (!(map = locate(sm, key, len, hash, &i))) {
+        if (sm->size + sm->deleted == sm->msize && grow(sm)) {
+            find(sm, key, len, hash, &i);
+        }
+        if (sm->size + sm->deleted < sm->msize && (key = own(sm, key, len))) {
+            put(sm, i, key, len, 0, hash);
+            ++(sm->size);
+            map = sm;
+        }
+        res = (map ? SM_INSERTED : SM_MAP_FULL);
+    }
+
+    if (result) {
+        *result = res;
+    }
+    return (map ? value(map, i) : 0);
+}
+
 void
 sm_foreach(const STRMAP * sm, void (*action) (SM_ENTRY item, void *ctx), void *ctx)
 {
-    SM_ENTRY *entry, *stop;
+    const STRMAP *map;
+    SM_ENTRY item;
+    size_t i;
     assert(sm);
 
-    stop = sm->ht + sm->capacity;
-    for (entry = sm->ht; entry != stop; ++entry) {
-        if (entry->key) {
-            action(*entry, ctx);
+    for (map = sm; map; map = map->old) {
+        for (i = 0; i < map->capacity; ++i) {
+            if (used(map, i)) {
+                view(map, i, &item);
+                action(item, ctx);
+            }
         }
     }
 }
@@ -277,7 +955,8 @@ sm_foreach(const STRMAP * sm, void (*action) (SM_ENTRY item, void *ctx), void *c
 double
 sm_probes_mean(const STRMAP * sm)
 {
-    SM_ENTRY *entry, *root, *stop;
+    const STRMAP *map;
+    size_t i;
     double mean;
 
     assert(sm);
@@ -286,11 +965,11 @@ sm_probes_mean(const STRMAP * sm)
         return 0.0;
     }
 
-    stop = sm->ht + sm->capacity;
-    for (mean = 0.0, entry = sm->ht; entry != stop; ++entry) {
-        if (entry->key) {
-            root = sm->ht + POSITION(entry->hash, sm->capacity);
-            mean += (double)distance(root, entry, sm->capacity);
+    for (mean = 0.0, map = sm; map; map = map->old) {
+        for (i = 0; i < map->capacity; ++i) {
+            if (used(map, i)) {
+                mean += (double)probes(map, i);
+            }
         }
     }
 
@@ -300,7 +979,8 @@ sm_probes_mean(const STRMAP * sm)
 double
 sm_probes_var(const STRMAP * sm)
 {
-    SM_ENTRY *entry, *root, *stop;
+    const STRMAP *map;
+    size_t i;
     double var, diff, mean;
 
     assert(sm);
@@ -310,12 +990,12 @@ sm_probes_var(const STRMAP * sm)
     }
 
     mean = sm_probes_mean(sm);
-    stop = sm->ht + sm->capacity;    
-    for (var = 0.0, entry = sm->ht; entry != stop; ++entry) {
-        if (entry->key) {
-            root = sm->ht + POSITION(entry->hash, sm->capacity);
-            diff = mean - (double)distance(root, entry, sm->capacity);
-            var += diff * diff;
+    for (var = 0.0, map = sm; map; map = map->old) {
+        for (i = 0; i < map->capacity; ++i) {
+            if (used(map, i)) {
+                diff = mean - (double)probes(map, i);
+                var += diff * diff;
+            }
         }
     }
 
@@ -325,157 +1005,2417 @@ sm_probes_var(const STRMAP * sm)
 void
 sm_clear(STRMAP * sm)
 {
-    SM_ENTRY *entry, *stop;
     assert(sm);
 
-    stop = sm->ht + sm->capacity;
-    for (entry = sm->ht; entry != stop; ++entry) {
-        *entry = EMPTY;
-    }
-    sm->size = 0;
+    begin_write(sm);
+    clear(sm);
+    end_write(sm);
 }
 
-size_t
-sm_size(const STRMAP * sm)
+int
+sm_reserve(STRMAP * sm, size_t size)
 {
+    STRMAP *map;
+
     assert(sm);
 
-    return sm->size;
+    if (size <= sm->msize) {
+        return 0;
+    }
+    begin_write(sm);
+    map = resize(sm, size);
+    end_write(sm);
+    return map ? 0 : -1;
 }
 
-double
-sm_load_factor(const STRMAP * sm)
+int
+sm_shrink_to_fit(STRMAP * sm)
 {
+    STRMAP *map;
+
     assert(sm);
 
-    return (double)sm->size / sm->capacity;
+    begin_write(sm);
+    map = rehash(sm, sm->size);
+    end_write(sm);
+    return map ? 0 : -1;
 }
 
+/*
+ * SM_SEQLOCK: tables and keys replaced so far are not read by lookups
+ */
 void
-sm_free(STRMAP * sm)
+sm_reclaim(STRMAP * sm)
 {
-    assert(sm);
-
-    free(sm->ht);
-    free(sm);
-}
+    SM_RETIRED *r;
 
-size_t
-poly_hashs(const char *key)
-{
-    size_t hash = 0;
+    assert(sm);
 
-    while (*key) {
-        hash += (hash << 8) + (unsigned char) (*key);
-        ++key;
+    while ((r = sm->retired)) {
+        sm->retired = r->next;
+        table_free(sm->opt.alloc, r->table, r->mapped);
+        arena_release(sm, r->arena);
+        release(sm, r);
     }
-
-    return hash;
 }
 
 /*
- * private static functions
+ * remove all keys, SM_SEQLOCK: keys are retired, kept in the arena if
+ * that fails
  */
-
-static size_t
-distance(const SM_ENTRY * from, const SM_ENTRY * to, size_t range)
+static void
+clear(STRMAP * sm)
 {
-    return to >= from ? to - from : range - (from - to);
-}
-
-static size_t 
-POSITION(size_t x, size_t range) {
-    return x % range;
-}
+    STRMAP *map;
+    size_t i;
 
-static size_t
-adjust(size_t x) 
-{
-    static const int WHEEL[30] = {
-        1, 0, 5, 4, 3, 2,
-        1, 0, 3, 2, 1, 0,
-        1, 0, 3, 2, 1, 0,
-        1, 0, 3, 2, 1, 0,
+    if (sm->old) {
+        free_old(sm);
+    }
+    if (sm->opt.flags & SM_SEQLOCK) {
+        retire(sm, 0);
+    }
+    else if (sm->arena) {
+        arena_release(sm, sm->arena);
+        sm->arena = 0;
+    }
+    if (sm->opt.shrink && sm->msize > MIN_SIZE
+        && (map = sm_create_ex(0, &sm->opt))) {
+        if (drop_table(sm)) {
+            adopt(sm, map);
+            sm->size = 0;
+            return;
+        }
+        sm_free(map);
+    }
+    if (sm->ndirty < sm->maxdirty) {
+        /* written slots only */
+        while (sm->ndirty) {
+            reset(sm, sm->dirty[--(sm->ndirty)]);
+        }
+        sm->size = 0;
+        sm->deleted = 0;
+        return;
+    }
+    sm->ndirty = 0;
+    if (sm->it) {
+        memset(sm->it, 0, sm->capacity * sizeof (SM_ISLOT));
+    }
+    else if (sm->ct) {
+        memset(sm->ct, 0, sm->capacity * sizeof (SM_CSLOT));
+    }
+    else if (sm->kt) {
+        memset(sm->kt, 0, sm->capacity * sizeof (SM_KSLOT));
+    }
+    else {
+        for (i = 0; i < sm->capacity; ++i) {
+            set_entry(sm, i, &EMPTY);
+        }
+    }
+    if (sm->tags) {
+        memset(sm->tags, 0, sm->capacity * sizeof (unsigned int));
+    }
+    if (sm->ctrl) {
+        memset(sm->ctrl, CTRL_EMPTY, sm->capacity);
+    }
+    sm->size = 0;
+    sm->deleted = 0;
+}
+
+int
+sm_migrating(const STRMAP * sm)
+{
+    assert(sm);
+
+    return sm->old != 0;
+}
+
+size_t
+sm_size(const STRMAP * sm)
+{
+    assert(sm);
+
+    return sm->size;
+}
+
+double
+sm_load_factor(const STRMAP * sm)
+{
+    assert(sm);
+
+    return (double)sm->size / sm->capacity;
+}
+
+size_t
+sm_memory_usage(const STRMAP * sm, SM_MEMORY * usage)
+{
+    const STRMAP *map;
+    const SM_RETIRED *r;
+    SM_MEMORY m;
+    size_t values, log;
+
+    assert(sm);
+
+    m.table = m.map = m.keys = 0;
+    for (map = sm; map; map = map->old) {
+        m.table += (map->mapped ? map->mapped
+                    : layout(&map->opt, map->capacity, &values, &log));
+        m.map += sizeof (STRMAP);
+    }
+    if (sm->arena) {
+        m.keys = sizeof (SM_ARENA) + sm->arena->slots * sizeof (char *)
+            + sm->arena->bytes;
+    }
+    for (r = sm->retired; r; r = r->next) {
+        m.table += r->bytes;
+        m.map += sizeof (SM_RETIRED);
+        if (r->arena) {
+            m.keys += sizeof (SM_ARENA) + r->arena->slots * sizeof (char *)
+                + r->arena->bytes;
+        }
+    }
+    m.total = m.table + m.map + m.keys;
+    m.per_key = (sm->size ? (double)m.total / (double)sm->size : 0.0);
+    if (usage) {
+        *usage = m;
+    }
+
+    return m.total;
+}
+
+void
+sm_free(STRMAP * sm)
+{
+    assert(sm);
+
+    if (sm->old) {
+        free_old(sm);
+    }
+    sm_reclaim(sm);
+    arena_release(sm, sm->arena);
+    release_table(sm);
+    release(sm, sm);
+}
+
+/* powers of 257 modulo 2^N for 8 bytes chunks */
+#define P1 ((size_t)257)
+#define P2 (P1 * P1)
+#define P3 (P2 * P1)
+#define P4 (P2 * P2)
+#define P5 (P4 * P1)
+#define P6 (P4 * P2)
+#define P7 (P4 * P3)
+#define P8 (P4 * P4)
+
+/* polynomial of 8 bytes, x * 257 is (x << 8) + x */
+#define PAIR(s, i) ((((size_t)(s)[i]) << 8) + (s)[i] + (s)[(i) + 1])
+#define CHUNK(s) \
+    ((PAIR(s, 0) * P2 + PAIR(s, 2)) * P4 + PAIR(s, 4) * P2 + PAIR(s, 6))
+
+/*
+ * little endian 64 bit GCC compatible targets scan key by aligned words,
+ * aligned reads never cross a page, so the word holding the terminator
+ * may be read past the string end
+ */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && ULONG_MAX > 0xffffffffUL
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define WORD_SCAN
+#endif
+#endif
+
+/* lowest set high bit marks first zero byte of word */
+#define ONES ((size_t)-1 / UCHAR_MAX)
+#define HASZERO(w) (((w) - ONES) & ~(w) & (ONES << (CHAR_BIT - 1)))
+
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_ASAN __attribute__ ((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_ASAN __attribute__ ((no_sanitize_address))
+#endif
+#endif
+#ifndef NO_ASAN
+#define NO_ASAN
+#endif
+
+/*
+ * hash(s) = s[0]*257^(n-1) + ... + s[n-1] modulo 2^N,
+ * 8 bytes per step, terminator found by word test
+ */
+NO_ASAN size_t
+poly_hashs(const char *key)
+{
+    size_t hash = 0;
+#ifdef WORD_SCAN
+    const unsigned char *s;
+    size_t w, z, i, skip;
+
+    /* first word: bytes before key are set to be non zero */
+    skip = (size_t)key % 8;
+    s = (const unsigned char *)key - skip;
+    memcpy(&w, s, 8);
+    w |= ((size_t)1 << skip * CHAR_BIT) - 1;
+
+    for (; !(z = HASZERO(w)); skip = 0) {
+        if (skip) {
+            for (i = skip; i < 8; ++i) {
+                hash = hash * P1 + s[i];
+            }
+        }
+        else {
+            hash = hash * P8 + CHUNK(s);
+        }
+        s += 8;
+        memcpy(&w, s, 8);
+    }
+    for (z = (size_t)__builtin_ctzl(z) / CHAR_BIT, i = skip; i < z; ++i) {
+        hash = hash * P1 + s[i];
+    }
+#else
+    while (*key) {
+        hash = hash * P1 + (unsigned char) (*key);
+        ++key;
+    }
+#endif
+
+    return hash;
+}
+
+/*
+ * same polynomial as poly_hashs, 8 bytes per step
+ */
+size_t
+poly_hashn(const char *key, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)key;
+    size_t hash = 0;
+
+    for (; len >= 8; len -= 8, s += 8) {
+        hash = hash * P8 + CHUNK(s);
+    }
+    while (len--) {
+        hash = hash * P1 + *s++;
+    }
+
+    return hash;
+}
+
+/*
+ * wyhash style hash: 16 bytes per step folded by 64x64 -> 128 bit
+ * multiplication, 3 independent lanes for long keys.
+ * Words are read in native byte order.
+ */
+#if ULONG_MAX > 0xffffffffUL
+
+static const unsigned long WY[4] = {
+    0xa0761d6478bd642fUL, 0xe7037ed1a0b428dbUL,
+    0x8ebc6af09c88c6e3UL, 0x589965cc75374cc3UL
+};
+
+static unsigned long
+WYR8(const unsigned char *p)
+{
+    unsigned long v;
+
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static unsigned long
+WYR4(const unsigned char *p)
+{
+    unsigned int v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/*
+ * low ^ high half of 128 bit product
+ */
+static unsigned long
+WYMIX(unsigned long a, unsigned long b)
+{
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 U128;
+    U128 r = (U128)a * b;
+
+    return (unsigned long)r ^ (unsigned long)(r >> 64);
+#else
+    unsigned long ha = a >> 32, hb = b >> 32, la = a & 0xffffffffUL,
+        lb = b & 0xffffffffUL, hi, lo, rh, rm0, rm1, rl, t;
+    int c;
+
+    rh = ha * hb;
+    rm0 = ha * lb;
+    rm1 = hb * la;
+    rl = la * lb;
+    t = rl + (rm0 << 32);
+    c = t < rl;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + (unsigned long)c;
+    return lo ^ hi;
+#endif
+}
+
+size_t
+sm_hash_wy(const char *key, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    unsigned long a, b, seed, see1, see2;
+    size_t i;
+
+    seed = WYMIX(WY[0], WY[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (WYR4(p) << 32) | WYR4(p + ((len >> 3) << 2));
+            b = (WYR4(p + len - 4) << 32) | WYR4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0) {
+            a = ((unsigned long)p[0] << 16) | ((unsigned long)p[len >> 1] << 8)
+                | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        i = len;
+        if (i > 48) {
+            see1 = see2 = seed;
+            do {
+                seed = WYMIX(WYR8(p) ^ WY[1], WYR8(p + 8) ^ seed);
+                see1 = WYMIX(WYR8(p + 16) ^ WY[2], WYR8(p + 24) ^ see1);
+                see2 = WYMIX(WYR8(p + 32) ^ WY[3], WYR8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = WYMIX(WYR8(p) ^ WY[1], WYR8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = WYR8(p + i - 16);
+        b = WYR8(p + i - 8);
+    }
+
+    return WYMIX(WY[1] ^ len, WYMIX(a ^ WY[1], b ^ seed));
+}
+
+#else
+
+/*
+ * 32 bit size_t: murmur3 style 4 bytes per step
+ */
+size_t
+sm_hash_wy(const char *key, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    unsigned long h = 0x9747b28cUL, k;
+    size_t i;
+
+    for (i = len; i >= 4; i -= 4, p += 4) {
+        k = (unsigned long)p[0] | (unsigned long)p[1] << 8
+            | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+        k = (k * 0xcc9e2d51UL) & 0xffffffffUL;
+        k = ((k << 15) | (k >> 17)) & 0xffffffffUL;
+        h ^= (k * 0x1b873593UL) & 0xffffffffUL;
+        h = ((h << 13) | (h >> 19)) & 0xffffffffUL;
+        h = (h * 5 + 0xe6546b64UL) & 0xffffffffUL;
+    }
+    for (k = 0; i; --i) {
+        k = (k << 8) | p[i - 1];
+    }
+    k = (k * 0xcc9e2d51UL) & 0xffffffffUL;
+    k = ((k << 15) | (k >> 17)) & 0xffffffffUL;
+    h ^= (k * 0x1b873593UL) & 0xffffffffUL;
+    h ^= (unsigned long)len;
+
+    return MIX((size_t)h);
+}
+
+#endif
+
+/*
+ * CRC32C (Castagnoli), SSE4.2 crc32 instruction when available.
+ * 32 bit result is spread over size_t by odd multiplier.
+ */
+#if !defined(CRC32C_SSE42) || !defined(__SSE4_2__)
+static const unsigned long CRC32C[256] = {
+    0x00000000UL, 0xf26b8303UL, 0xe13b70f7UL, 0x1350f3f4UL, 0xc79a971fUL,
+    0x35f1141cUL, 0x26a1e7e8UL, 0xd4ca64ebUL, 0x8ad958cfUL, 0x78b2dbccUL,
+    0x6be22838UL, 0x9989ab3bUL, 0x4d43cfd0UL, 0xbf284cd3UL, 0xac78bf27UL,
+    0x5e133c24UL, 0x105ec76fUL, 0xe235446cUL, 0xf165b798UL, 0x030e349bUL,
+    0xd7c45070UL, 0x25afd373UL, 0x36ff2087UL, 0xc494a384UL, 0x9a879fa0UL,
+    0x68ec1ca3UL, 0x7bbcef57UL, 0x89d76c54UL, 0x5d1d08bfUL, 0xaf768bbcUL,
+    0xbc267848UL, 0x4e4dfb4bUL, 0x20bd8edeUL, 0xd2d60dddUL, 0xc186fe29UL,
+    0x33ed7d2aUL, 0xe72719c1UL, 0x154c9ac2UL, 0x061c6936UL, 0xf477ea35UL,
+    0xaa64d611UL, 0x580f5512UL, 0x4b5fa6e6UL, 0xb93425e5UL, 0x6dfe410eUL,
+    0x9f95c20dUL, 0x8cc531f9UL, 0x7eaeb2faUL, 0x30e349b1UL, 0xc288cab2UL,
+    0xd1d83946UL, 0x23b3ba45UL, 0xf779deaeUL, 0x05125dadUL, 0x1642ae59UL,
+    0xe4292d5aUL, 0xba3a117eUL, 0x4851927dUL, 0x5b016189UL, 0xa96ae28aUL,
+    0x7da08661UL, 0x8fcb0562UL, 0x9c9bf696UL, 0x6ef07595UL, 0x417b1dbcUL,
+    0xb3109ebfUL, 0xa0406d4bUL, 0x522bee48UL, 0x86e18aa3UL, 0x748a09a0UL,
+    0x67dafa54UL, 0x95b17957UL, 0xcba24573UL, 0x39c9c670UL, 0x2a993584UL,
+    0xd8f2b687UL, 0x0c38d26cUL, 0xfe53516fUL, 0xed03a29bUL, 0x1f682198UL,
+    0x5125dad3UL, 0xa34e59d0UL, 0xb01eaa24UL, 0x42752927UL, 0x96bf4dccUL,
+    0x64d4cecfUL, 0x77843d3bUL, 0x85efbe38UL, 0xdbfc821cUL, 0x2997011fUL,
+    0x3ac7f2ebUL, 0xc8ac71e8UL, 0x1c661503UL, 0xee0d9600UL, 0xfd5d65f4UL,
+    0x0f36e6f7UL, 0x61c69362UL, 0x93ad1061UL, 0x80fde395UL, 0x72966096UL,
+    0xa65c047dUL, 0x5437877eUL, 0x4767748aUL, 0xb50cf789UL, 0xeb1fcbadUL,
+    0x197448aeUL, 0x0a24bb5aUL, 0xf84f3859UL, 0x2c855cb2UL, 0xdeeedfb1UL,
+    0xcdbe2c45UL, 0x3fd5af46UL, 0x7198540dUL, 0x83f3d70eUL, 0x90a324faUL,
+    0x62c8a7f9UL, 0xb602c312UL, 0x44694011UL, 0x5739b3e5UL, 0xa55230e6UL,
+    0xfb410cc2UL, 0x092a8fc1UL, 0x1a7a7c35UL, 0xe811ff36UL, 0x3cdb9bddUL,
+    0xceb018deUL, 0xdde0eb2aUL, 0x2f8b6829UL, 0x82f63b78UL, 0x709db87bUL,
+    0x63cd4b8fUL, 0x91a6c88cUL, 0x456cac67UL, 0xb7072f64UL, 0xa457dc90UL,
+    0x563c5f93UL, 0x082f63b7UL, 0xfa44e0b4UL, 0xe9141340UL, 0x1b7f9043UL,
+    0xcfb5f4a8UL, 0x3dde77abUL, 0x2e8e845fUL, 0xdce5075cUL, 0x92a8fc17UL,
+    0x60c37f14UL, 0x73938ce0UL, 0x81f80fe3UL, 0x55326b08UL, 0xa759e80bUL,
+    0xb4091bffUL, 0x466298fcUL, 0x1871a4d8UL, 0xea1a27dbUL, 0xf94ad42fUL,
+    0x0b21572cUL, 0xdfeb33c7UL, 0x2d80b0c4UL, 0x3ed04330UL, 0xccbbc033UL,
+    0xa24bb5a6UL, 0x502036a5UL, 0x4370c551UL, 0xb11b4652UL, 0x65d122b9UL,
+    0x97baa1baUL, 0x84ea524eUL, 0x7681d14dUL, 0x2892ed69UL, 0xdaf96e6aUL,
+    0xc9a99d9eUL, 0x3bc21e9dUL, 0xef087a76UL, 0x1d63f975UL, 0x0e330a81UL,
+    0xfc588982UL, 0xb21572c9UL, 0x407ef1caUL, 0x532e023eUL, 0xa145813dUL,
+    0x758fe5d6UL, 0x87e466d5UL, 0x94b49521UL, 0x66df1622UL, 0x38cc2a06UL,
+    0xcaa7a905UL, 0xd9f75af1UL, 0x2b9cd9f2UL, 0xff56bd19UL, 0x0d3d3e1aUL,
+    0x1e6dcdeeUL, 0xec064eedUL, 0xc38d26c4UL, 0x31e6a5c7UL, 0x22b65633UL,
+    0xd0ddd530UL, 0x0417b1dbUL, 0xf67c32d8UL, 0xe52cc12cUL, 0x1747422fUL,
+    0x49547e0bUL, 0xbb3ffd08UL, 0xa86f0efcUL, 0x5a048dffUL, 0x8ecee914UL,
+    0x7ca56a17UL, 0x6ff599e3UL, 0x9d9e1ae0UL, 0xd3d3e1abUL, 0x21b862a8UL,
+    0x32e8915cUL, 0xc083125fUL, 0x144976b4UL, 0xe622f5b7UL, 0xf5720643UL,
+    0x07198540UL, 0x590ab964UL, 0xab613a67UL, 0xb831c993UL, 0x4a5a4a90UL,
+    0x9e902e7bUL, 0x6cfbad78UL, 0x7fab5e8cUL, 0x8dc0dd8fUL, 0xe330a81aUL,
+    0x115b2b19UL, 0x020bd8edUL, 0xf0605beeUL, 0x24aa3f05UL, 0xd6c1bc06UL,
+    0xc5914ff2UL, 0x37faccf1UL, 0x69e9f0d5UL, 0x9b8273d6UL, 0x88d28022UL,
+    0x7ab90321UL, 0xae7367caUL, 0x5c18e4c9UL, 0x4f48173dUL, 0xbd23943eUL,
+    0xf36e6f75UL, 0x0105ec76UL, 0x12551f82UL, 0xe03e9c81UL, 0x34f4f86aUL,
+    0xc69f7b69UL, 0xd5cf889dUL, 0x27a40b9eUL, 0x79b737baUL, 0x8bdcb4b9UL,
+    0x988c474dUL, 0x6ae7c44eUL, 0xbe2da0a5UL, 0x4c4623a6UL, 0x5f16d052UL,
+    0xad7d5351UL
+};
+#endif
+
+#ifdef CRC32C_SSE42
+/*
+ * 8 bytes per crc32 instruction, GCC compatible compilers build it
+ * for SSE4.2 and select it at run time
+ */
+#ifndef __SSE4_2__
+__attribute__ ((target("sse4.2")))
+#endif
+static unsigned long
+crc32c_sse42(unsigned long crc, const unsigned char *p, size_t len)
+{
+    unsigned long w;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        memcpy(&w, p, 8);
+        crc = (unsigned long)_mm_crc32_u64(crc, w);
+    }
+    for (; len; --len) {
+        crc = _mm_crc32_u8((unsigned int)crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+size_t
+sm_hash_crc32c(const char *key, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    unsigned long crc = 0xffffffffUL;
+
+#if defined(CRC32C_SSE42) && defined(__SSE4_2__)
+    crc = crc32c_sse42(crc, p, len);
+#else
+#ifdef CRC32C_SSE42
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc = crc32c_sse42(crc, p, len);
+    }
+    else
+#endif
+    for (; len; --len) {
+        crc = CRC32C[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+#endif
+    crc ^= 0xffffffffUL;
+
+#if ULONG_MAX > 0xffffffffUL
+    return (size_t)(crc * 0x9e3779b97f4a7c15UL);
+#else
+    return (size_t)crc;
+#endif
+}
+
+/*
+ * private static functions
+ */
+
+/*
+ * number of probes (SM_SWISS: groups) before entry is reached
+ */
+static size_t
+probes(const STRMAP * sm, size_t i)
+{
+    size_t g, gmask, n;
+
+    if (sm->dist && sm->dist[i] < UCHAR_MAX) {
+        return sm->dist[i];
+    }
+    if (sm->ctrl) {
+        gmask = sm->capacity / GROUP - 1;
+        g = (MIX(sm->ht[i].hash) >> 7) & gmask;
+        for (n = 0; g != i / GROUP; ) {
+            g = (g + ++n) & gmask;
+        }
+        return n;
+    }
+
+    return distance(POSITION(sm, stored_hash(sm, i)), i, sm->capacity);
+}
+
+/*
+ * SM_ROBIN_HOOD: cache probe distance `n` of slot `i`, larger ones are
+ * recomputed by probes
+ */
+static void
+set_probes(STRMAP * sm, size_t i, size_t n)
+{
+    sm->dist[i] = (unsigned char)(n < UCHAR_MAX ? n : UCHAR_MAX);
+}
+
+static size_t
+distance(size_t from, size_t to, size_t range)
+{
+    return to >= from ? to - from : range - (from - to);
+}
+
+/*
+ * SM_POW2: finalized hash masked by capacity - 1, no division
+ */
+static size_t
+POSITION(const STRMAP * sm, size_t hash)
+{
+    if (sm->opt.flags & SM_POW2) {
+        return MIX(hash) & (sm->capacity - 1);
+    }
+    return hash % sm->capacity;
+}
+
+static size_t
+adjust(size_t x) 
+{
+    static const int WHEEL[30] = {
+        1, 0, 5, 4, 3, 2,
+        1, 0, 3, 2, 1, 0,
+        1, 0, 3, 2, 1, 0,
+        1, 0, 3, 2, 1, 0,
         5, 4, 3, 2, 1, 0
     };
     x += WHEEL[x % 30];
     assert((x % 2) && (x % 3) && (x % 5));
 
-    return x;
+    return x;
+}
+
+/*
+ * fold hash into non zero 32 bit tag
+ */
+static unsigned int
+TAG(size_t hash)
+{
+    return (unsigned int)(hash ^ (hash >> 16 >> 16)) | 0x80000000u;
+}
+
+/*
+ * hash finalizer, spreads weak polynomial hash bits
+ */
+static size_t
+MIX(size_t hash)
+{
+    SM_MIX(hash);
+    return hash;
+}
+
+/*
+ * bit mask of group slots with control byte `c`
+ */
+static unsigned int
+MATCH(const unsigned char *ctrl, unsigned char c)
+{
+#if GROUP == 32
+    __m256i g = _mm256_loadu_si256((const __m256i *)ctrl);
+
+    return (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(g, _mm256_set1_epi8((char)c)));
+#elif defined(GROUP_SSE2)
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+#else
+    unsigned int bits, i;
+
+    for (bits = 0, i = 0; i < GROUP; ++i) {
+        bits |= (unsigned int)(ctrl[i] == c) << i;
+    }
+    return bits;
+#endif
+}
+
+/*
+ * bit mask of empty or deleted group slots
+ */
+static unsigned int
+AVAILABLE(const unsigned char *ctrl)
+{
+#if GROUP == 32
+    __m256i g = _mm256_loadu_si256((const __m256i *)ctrl);
+
+    return ~(unsigned int)_mm256_movemask_epi8(g);
+#elif defined(GROUP_SSE2)
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+
+    return ~(unsigned int)_mm_movemask_epi8(g) & 0xffffu;
+#else
+    unsigned int bits, i;
+
+    for (bits = 0, i = 0; i < GROUP; ++i) {
+        bits |= (unsigned int)(ctrl[i] < CTRL_FULL) << i;
+    }
+    return bits;
+#endif
+}
+
+static unsigned int
+LOWEST(unsigned int bits)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctz(bits);
+#else
+    unsigned int i;
+
+    for (i = 0; !(bits & 1u); ++i) {
+        bits >>= 1;
+    }
+    return i;
+#endif
+}
+
+/*
+ * find entry with given key and hash in collision chain, `slot` receives
+ * found entry or insertion point
+ */
+int
+find(const STRMAP * sm, const char *key, size_t len, size_t hash,
+     size_t * slot)
+{
+    SM_ENTRY *entry, *stop;
+
+    if (sm->tags) {
+        return find_split(sm, key, len, hash, slot);
+    }
+    if (sm->ctrl) {
+        return find_swiss(sm, key, len, hash, slot);
+    }
+    if (sm->opt.flags & SM_ROBIN_HOOD) {
+        return find_robin_hood(sm, key, len, hash, slot);
+    }
+    if (sm->it) {
+        return find_inline(sm, key, len, hash, slot);
+    }
+    if (sm->ct) {
+        return find_compact(sm, key, len, hash, slot);
+    }
+    if (sm->kt) {
+        return find_keys(sm, key, len, hash, slot);
+    }
+
+    entry = sm->ht + POSITION(sm, hash);
+    stop = sm->ht + sm->capacity;
+
+    while (entry->key) {
+        if (hash == entry->hash && len == entry->len) {
+            if (!memcmp(key, entry->key, len)) {
+                break;
+            }
+        }
+
+        if (++entry == stop) {
+            entry = sm->ht;
+        }
+    }
+
+    *slot = (size_t)(entry - sm->ht);
+    return entry->key != 0;
+}
+
+/*
+ * short keys are matched by tag and bytes of the slot
+ */
+int
+find_inline(const STRMAP * sm, const char *key, size_t len, size_t hash,
+            size_t * slot)
+{
+    const SM_ISLOT *s;
+    const char *ptr;
+    size_t i;
+    unsigned char tag, t;
+
+    tag = (unsigned char)(len < INLINE_TAG ? len + 1 : LONG_KEY);
+    i = POSITION(sm, hash);
+
+    while ((t = (unsigned char)sm->it[i].key[INLINE_TAG])) {
+        s = sm->it + i;
+        if (hash == s->hash && tag == t) {
+            if (tag != LONG_KEY) {
+                if (!memcmp(key, s->key, len)) {
+                    break;
+                }
+            }
+            else {
+                memcpy(&ptr, s->key, sizeof ptr);
+                if (len == long_len(s) && !memcmp(key, ptr, len)) {
+                    break;
+                }
+            }
+        }
+
+        if (++i == sm->capacity) {
+            i = 0;
+        }
+    }
+
+    *slot = i;
+    return t != 0;
+}
+
+/*
+ * SM_COMPACT: key is loaded on 32 bit hash match only
+ */
+int
+find_compact(const STRMAP * sm, const char *key, size_t len, size_t hash,
+             size_t * slot)
+{
+    const SM_CSLOT *s;
+    const char *ptr;
+    size_t i;
+
+    i = POSITION(sm, hash);
+
+    while ((s = sm->ct + i)->ref) {
+        if (hash == s->hash) {
+            ptr = compact_key(sm, s->ref);
+            if (len == compact_len(ptr) && !memcmp(key, ptr, len)) {
+                break;
+            }
+        }
+
+        if (++i == sm->capacity) {
+            i = 0;
+        }
+    }
+
+    *slot = i;
+    return s->ref != 0;
+}
+
+/*
+ * SM_KEYS_ONLY: four slots per cache line
+ */
+int
+find_keys(const STRMAP * sm, const char *key, size_t len, size_t hash,
+          size_t * slot)
+{
+    const SM_KSLOT *s;
+    size_t i;
+
+    i = POSITION(sm, hash);
+
+    while ((s = sm->kt + i)->key) {
+        if (hash == s->hash && len == s->len && !memcmp(key, s->key, len)) {
+            break;
+        }
+
+        if (++i == sm->capacity) {
+            i = 0;
+        }
+    }
+
+    *slot = i;
+    return s->key != 0;
+}
+
+#ifdef SEQLOCK
+/*
+ * SM_SEQLOCK: probe a snapshot of the table taken while no writer ran,
+ * retry when the sequence moved; tables and keys it points to are
+ * retired, not freed, so stale reads stay inside allocated memory.
+ * Fields the writer changes are read with relaxed atomic loads, the
+ * table pointer with acquire to see the slots of a new table
+ */
+static SM_RESULT
+lookup_seq(const STRMAP * sm, const char *key, size_t len, size_t hash,
+           SM_ENTRY * item)
+{
+    STRMAP map;
+    SM_ENTRY entry;
+    unsigned long seq;
+    size_t i;
+    int found;
+
+    map.opt.flags = sm->opt.flags;
+    for (;;) {
+        seq = SEQ_LOAD(&sm->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        map.ht = SEQ_LOAD(&sm->ht, __ATOMIC_ACQUIRE);
+        map.capacity = SEQ_LOAD(&sm->capacity, __ATOMIC_RELAXED);
+        SEQ_FENCE(__ATOMIC_ACQUIRE);
+        if (SEQ_LOAD(&sm->seq, __ATOMIC_RELAXED) != seq) {
+            continue;
+        }
+        found = find_seq(&map, key, len, hash, &i, &sm->seq, seq);
+        if (found > 0) {
+            entry.key = SEQ_LOAD(&map.ht[i].key, __ATOMIC_RELAXED);
+            entry.data = SEQ_LOAD(&map.ht[i].data, __ATOMIC_RELAXED);
+            entry.hash = SEQ_LOAD(&map.ht[i].hash, __ATOMIC_RELAXED);
+            entry.len = SEQ_LOAD(&map.ht[i].len, __ATOMIC_RELAXED);
+        }
+        SEQ_FENCE(__ATOMIC_ACQUIRE);
+        if (found >= 0 && SEQ_LOAD(&sm->seq, __ATOMIC_RELAXED) == seq) {
+            break;
+        }
+    }
+
+    if (found && item) {
+        *item = entry;
+    }
+    return found ? SM_FOUND : SM_NOT_FOUND;
+}
+
+/*
+ * linear probe of SM_ENTRY slots, the sequence is checked before a key
+ * is compared, so the key pointer and length belong to one entry;
+ * -1 - writer ran, retry
+ */
+static int
+find_seq(const STRMAP * sm, const char *key, size_t len, size_t hash,
+         size_t * slot, const unsigned long *seq, unsigned long start)
+{
+    const SM_ENTRY *entry;
+    const char *k;
+    size_t i, n;
+
+    i = POSITION(sm, hash);
+
+    for (n = 0; n < sm->capacity; ++n) {
+        entry = sm->ht + i;
+        if (!(k = SEQ_LOAD(&entry->key, __ATOMIC_RELAXED))) {
+            *slot = i;
+            return 0;
+        }
+        if (hash == SEQ_LOAD(&entry->hash, __ATOMIC_RELAXED)
+            && len == SEQ_LOAD(&entry->len, __ATOMIC_RELAXED)) {
+            SEQ_FENCE(__ATOMIC_ACQUIRE);
+            if (SEQ_LOAD(seq, __ATOMIC_RELAXED) != start) {
+                return -1;
+            }
+            if (!memcmp(key, k, len)) {
+                *slot = i;
+                return 1;
+            }
+        }
+
+        if (++i == sm->capacity) {
+            i = 0;
+        }
+    }
+
+    return -1;
+}
+#endif
+
+/*
+ * SM_SEQLOCK: sequence is odd while the map changes, stores that follow
+ * are ordered after it
+ */
+static void
+begin_write(STRMAP * sm)
+{
+#ifdef SEQLOCK
+    if (sm->opt.flags & SM_SEQLOCK) {
+        SEQ_STORE(&sm->seq, sm->seq + 1, __ATOMIC_RELAXED);
+        SEQ_FENCE(__ATOMIC_RELEASE);
+    }
+#else
+    (void)sm;
+#endif
+}
+
+static void
+end_write(STRMAP * sm)
+{
+#ifdef SEQLOCK
+    if (sm->opt.flags & SM_SEQLOCK) {
+        SEQ_STORE(&sm->seq, sm->seq + 1, __ATOMIC_RELEASE);
+    }
+#else
+    (void)sm;
+#endif
+}
+
+/*
+ * store SM_ENTRY slot, SM_SEQLOCK: relaxed atomic stores, lookups read
+ * the fields concurrently
+ */
+static void
+set_entry(STRMAP * sm, size_t i, const SM_ENTRY * entry)
+{
+#ifdef SEQLOCK
+    SM_ENTRY *e;
+
+    if (sm->opt.flags & SM_SEQLOCK) {
+        e = sm->ht + i;
+        SEQ_STORE(&e->key, entry->key, __ATOMIC_RELAXED);
+        SEQ_STORE(&e->data, entry->data, __ATOMIC_RELAXED);
+        SEQ_STORE(&e->hash, entry->hash, __ATOMIC_RELAXED);
+        SEQ_STORE(&e->len, entry->len, __ATOMIC_RELAXED);
+        return;
+    }
+#endif
+    sm->ht[i] = *entry;
+}
+
+/*
+ * replace table pointer and capacity, SM_SEQLOCK: atomic stores, the
+ * release one makes the slots of the new table visible to lookups
+ * loading the pointer
+ */
+static void
+set_table(STRMAP * sm, SM_ENTRY * ht, size_t capacity)
+{
+#ifdef SEQLOCK
+    if (sm->opt.flags & SM_SEQLOCK) {
+        SEQ_STORE(&sm->capacity, capacity, __ATOMIC_RELAXED);
+        SEQ_STORE(&sm->ht, ht, __ATOMIC_RELEASE);
+        return;
+    }
+#endif
+    sm->ht = ht;
+    sm->capacity = capacity;
+}
+
+/*
+ * stop at first entry closer to its root than the key would be,
+ * `slot` receives that entry (insertion point) or first empty
+ */
+int
+find_robin_hood(const STRMAP * sm, const char *key, size_t len, size_t hash,
+                size_t * slot)
+{
+    const SM_ENTRY *entry;
+    size_t i, d, n;
+
+    i = POSITION(sm, hash);
+
+    if (sm->ht) {
+        /* SM_ENTRY slots, cached distances, no per slot dispatch */
+        for (d = 0; (entry = sm->ht + i)->key; ++d) {
+            if (hash == entry->hash && len == entry->len
+                && !memcmp(key, entry->key, len)) {
+                *slot = i;
+                return 1;
+            }
+            if ((n = sm->dist[i]) == UCHAR_MAX) {
+                n = probes(sm, i);
+            }
+            if (n < d) {
+                break;
+            }
+            if (++i == sm->capacity) {
+                i = 0;
+            }
+        }
+        *slot = i;
+        return 0;
+    }
+
+    for (d = 0; used(sm, i); ++d) {
+        if (equal(sm, i, key, len, hash)) {
+            *slot = i;
+            return 1;
+        }
+        if (probes(sm, i) < d) {
+            break;
+        }
+
+        if (++i == sm->capacity) {
+            i = 0;
+        }
+    }
+
+    *slot = i;
+    return 0;
+}
+
+/*
+ * probe dense tags array, entry is loaded on tag match only
+ */
+int
+find_split(const STRMAP * sm, const char *key, size_t len, size_t hash,
+           size_t * slot)
+{
+    const unsigned int *tag, *stop;
+    unsigned int t;
+    SM_ENTRY *entry;
+
+    t = TAG(hash);
+    tag = sm->tags + POSITION(sm, hash);
+    stop = sm->tags + sm->capacity;
+
+    while (*tag) {
+        if (t == *tag) {
+            entry = sm->ht + (tag - sm->tags);
+            if (hash == entry->hash && len == entry->len
+                && !memcmp(key, entry->key, len)) {
+                break;
+            }
+        }
+
+        if (++tag == stop) {
+            tag = sm->tags;
+        }
+    }
+
+    *slot = (size_t)(tag - sm->tags);
+    return *tag != 0;
+}
+
+/*
+ * triangular probing over groups, `slot` receives first empty or deleted
+ * slot of the probe sequence
+ */
+int
+find_swiss(const STRMAP * sm, const char *key, size_t len, size_t hash,
+           size_t * slot)
+{
+    const unsigned char *ctrl;
+    SM_ENTRY *entry;
+    size_t m, g, gmask, i, avail;
+    unsigned int bits;
+    unsigned char h2;
+
+    m = MIX(hash);
+    h2 = (unsigned char)(CTRL_FULL | (m & 0x7f));
+    gmask = sm->capacity / GROUP - 1;
+    g = (m >> 7) & gmask;
+    avail = sm->capacity;
+
+    for (i = 0;;) {
+        ctrl = sm->ctrl + g * GROUP;
+        for (bits = MATCH(ctrl, h2); bits; bits &= bits - 1) {
+            entry = sm->ht + g * GROUP + LOWEST(bits);
+            if (hash == entry->hash && len == entry->len
+                && !memcmp(key, entry->key, len)) {
+                *slot = (size_t)(entry - sm->ht);
+                return 1;
+            }
+        }
+        if (avail == sm->capacity && (bits = AVAILABLE(ctrl))) {
+            avail = g * GROUP + LOWEST(bits);
+        }
+        if (MATCH(ctrl, CTRL_EMPTY)) {
+            break;
+        }
+        g = (g + ++i) & gmask;
+    }
+
+    *slot = avail;
+    return 0;
+}
+
+/*
+ * slot `i` holds key
+ */
+static int
+equal(const STRMAP * sm, size_t i, const char *key, size_t len, size_t hash)
+{
+    const SM_ISLOT *s;
+    const char *ptr;
+
+    if (sm->it) {
+        s = sm->it + i;
+        if (hash != s->hash) {
+            return 0;
+        }
+        if ((unsigned char)s->key[INLINE_TAG] != LONG_KEY) {
+            return (unsigned char)s->key[INLINE_TAG] == len + 1
+                && !memcmp(key, s->key, len);
+        }
+        memcpy(&ptr, s->key, sizeof ptr);
+        return len == long_len(s) && !memcmp(key, ptr, len);
+    }
+    if (sm->ct) {
+        if (hash != sm->ct[i].hash) {
+            return 0;
+        }
+        ptr = compact_key(sm, sm->ct[i].ref);
+        return len == compact_len(ptr) && !memcmp(key, ptr, len);
+    }
+    if (sm->kt) {
+        return hash == sm->kt[i].hash && len == sm->kt[i].len
+            && !memcmp(key, sm->kt[i].key, len);
+    }
+
+    return hash == sm->ht[i].hash && len == sm->ht[i].len
+        && !memcmp(key, sm->ht[i].key, len);
+}
+
+/*
+ * SM_COMPACT key copy in the arena
+ */
+static const char *
+compact_key(const STRMAP * sm, unsigned int ref)
+{
+    return sm->arena->chunks[(ref >> 16) - 1] + (ref & 0xffff);
+}
+
+static size_t
+compact_len(const char *key)
+{
+    unsigned int len;
+
+    memcpy(&len, key - sizeof len, sizeof len);
+    return len;
+}
+
+/*
+ * map hash of key; reads options only, which stay as created, so
+ * SM_SEQLOCK lookups call it while the writer runs
+ */
+static size_t
+key_hash(const STRMAP * sm, const char *key, size_t len)
+{
+    return map_hash(sm, sm->opt.hash(key, len));
+}
+
+/*
+ * map hash of option hash value, SM_COMPACT and SM_KEYS_ONLY keep low
+ * 32 bits
+ */
+static size_t
+map_hash(const STRMAP * sm, size_t hash)
+{
+    return (sm->opt.flags & (SM_COMPACT | SM_KEYS_ONLY))
+        ? (unsigned int)hash : hash;
+}
+
+/*
+ * length of long inline key, stored little endian after the pointer
+ */
+static size_t
+long_len(const SM_ISLOT * s)
+{
+    size_t len, i;
+
+    for (len = 0, i = INLINE_TAG; i-- > LONG_LEN; ) {
+        len = (len << CHAR_BIT) | (unsigned char)s->key[i];
+    }
+    return len;
+}
+
+static int
+used(const STRMAP * sm, size_t i)
+{
+    if (sm->it) {
+        return sm->it[i].key[INLINE_TAG] != 0;
+    }
+    if (sm->ct) {
+        return sm->ct[i].ref != 0;
+    }
+    if (sm->kt) {
+        return sm->kt[i].key != 0;
+    }
+    return sm->ht[i].key != 0;
+}
+
+static size_t
+stored_hash(const STRMAP * sm, size_t i)
+{
+    if (sm->ct) {
+        return sm->ct[i].hash;
+    }
+    if (sm->kt) {
+        return sm->kt[i].hash;
+    }
+    return sm->it ? sm->it[i].hash : sm->ht[i].hash;
+}
+
+/*
+ * public view of slot `i`, short inline key points into the slot,
+ * SM_COMPACT key and length are read from the arena
+ */
+static void
+view(const STRMAP * sm, size_t i, SM_ENTRY * item)
+{
+    const SM_ISLOT *s;
+    const SM_CSLOT *c;
+
+    if (sm->it) {
+        s = sm->it + i;
+        if ((unsigned char)s->key[INLINE_TAG] == LONG_KEY) {
+            memcpy(&item->key, s->key, sizeof item->key);
+            item->len = long_len(s);
+        }
+        else {
+            item->key = s->key;
+            item->len = (unsigned char)s->key[INLINE_TAG] - 1u;
+        }
+        item->data = s->data;
+        item->hash = s->hash;
+    }
+    else if (sm->ct) {
+        c = sm->ct + i;
+        item->key = compact_key(sm, c->ref);
+        item->len = compact_len(item->key);
+        item->data = c->data;
+        item->hash = c->hash;
+    }
+    else if (sm->kt) {
+        item->key = sm->kt[i].key;
+        item->len = sm->kt[i].len;
+        item->data = 0;
+        item->hash = sm->kt[i].hash;
+    }
+    else {
+        *item = sm->ht[i];
+    }
+    if (sm->values) {
+        item->data = value(sm, i);
+    }
+}
+
+static void
+set_data(STRMAP * sm, size_t i, const void *data)
+{
+    if (sm->values) {
+        store(sm, i, data);
+    }
+    else if (sm->it) {
+        sm->it[i].data = data;
+    }
+    else if (sm->ct) {
+        sm->ct[i].data = data;
+    }
+    else if (!sm->kt) {
+#ifdef SEQLOCK
+        if (sm->opt.flags & SM_SEQLOCK) {
+            SEQ_STORE(&sm->ht[i].data, data, __ATOMIC_RELAXED);
+            return;
+        }
+#endif
+        sm->ht[i].data = data;
+    }
+}
+
+/*
+ * store key into empty slot, SM_ROBIN_HOOD insertion point is
+ * vacated first; SM_COMPACT key must be an arena copy; value_size:
+ * `data` is copied into the map, slot keeps no pointer
+ */
+void
+put(STRMAP * sm, size_t i, const char *key, size_t len, const void *data,
+    size_t hash)
+{
+    SM_ENTRY entry;
+    SM_ISLOT *s;
+    unsigned char *ctrl;
+    size_t n, k;
+
+    if (used(sm, i)) {
+        displace(sm, i);
+    }
+    if (sm->dist) {
+        set_probes(sm, i, distance(POSITION(sm, hash), i, sm->capacity));
+    }
+    mark(sm, i);
+    if (sm->values) {
+        store(sm, i, data);
+        data = 0;
+    }
+
+    if (sm->it) {
+        s = sm->it + i;
+        if (len < INLINE_TAG) {
+            memcpy(s->key, key, len);
+            s->key[INLINE_TAG] = (char)(len + 1);
+        }
+        else {
+            memcpy(s->key, &key, sizeof key);
+            for (n = len, k = LONG_LEN; k < INLINE_TAG; ++k) {
+                s->key[k] = (char)(n & UCHAR_MAX);
+                n >>= CHAR_BIT;
+            }
+            s->key[INLINE_TAG] = (char)LONG_KEY;
+        }
+        s->data = data;
+        s->hash = hash;
+        return;
+    }
+    if (sm->ct) {
+        memcpy(&sm->ct[i].ref, key - KEY_HEADER, sizeof (unsigned int));
+        sm->ct[i].hash = (unsigned int)hash;
+        sm->ct[i].data = data;
+        return;
+    }
+    if (sm->kt) {
+        sm->kt[i].key = key;
+        sm->kt[i].hash = (unsigned int)hash;
+        sm->kt[i].len = (unsigned int)len;
+        return;
+    }
+
+    entry.key = key;
+    entry.data = data;
+    entry.hash = hash;
+    entry.len = len;
+    set_entry(sm, i, &entry);
+    if (sm->tags) {
+        sm->tags[i] = TAG(hash);
+    }
+    if (sm->ctrl) {
+        ctrl = sm->ctrl + i;
+        if (*ctrl == CTRL_DELETED) {
+            --(sm->deleted);
+        }
+        *ctrl = (unsigned char)(CTRL_FULL | (MIX(hash) & 0x7f));
+    }
+}
+
+/*
+ * move slot into empty slot
+ */
+void
+move(STRMAP * sm, size_t to, size_t from)
+{
+    mark(sm, to);
+    if (sm->dist) {
+        sm->dist[to] = sm->dist[from];
+    }
+    if (sm->values) {
+        memcpy(value(sm, to), value(sm, from), sm->opt.value_size);
+    }
+    if (sm->it) {
+        sm->it[to] = sm->it[from];
+        memset(sm->it + from, 0, sizeof (SM_ISLOT));
+        return;
+    }
+    if (sm->ct) {
+        sm->ct[to] = sm->ct[from];
+        memset(sm->ct + from, 0, sizeof (SM_CSLOT));
+        return;
+    }
+    if (sm->kt) {
+        sm->kt[to] = sm->kt[from];
+        memset(sm->kt + from, 0, sizeof (SM_KSLOT));
+        return;
+    }
+    set_entry(sm, to, sm->ht + from);
+    set_entry(sm, from, &EMPTY);
+    if (sm->tags) {
+        sm->tags[to] = sm->tags[from];
+        sm->tags[from] = 0;
+    }
+}
+
+/*
+ * shift slots from `i` up to the next empty one slot forward,
+ * keeps keys ordered by root position
+ */
+void
+displace(STRMAP * sm, size_t i)
+{
+    size_t empty, prev;
+
+    for (empty = i; used(sm, empty); ) {
+        if (++empty == sm->capacity) {
+            empty = 0;
+        }
+    }
+
+    while (empty != i) {
+        prev = (empty ? empty : sm->capacity) - 1;
+        move(sm, empty, prev);
+        if (sm->dist && sm->dist[empty] < UCHAR_MAX) {
+            ++(sm->dist[empty]);
+        }
+        empty = prev;
+    }
+}
+
+/*
+ * SM_SWISS: a group with an empty slot never was passed by a probe,
+ * so the slot may become empty, otherwise it becomes a tombstone
+ */
+void
+erase(STRMAP * sm, size_t i)
+{
+    if (sm->it) {
+        memset(sm->it + i, 0, sizeof (SM_ISLOT));
+        return;
+    }
+    if (sm->ct) {
+        memset(sm->ct + i, 0, sizeof (SM_CSLOT));
+        return;
+    }
+    if (sm->kt) {
+        memset(sm->kt + i, 0, sizeof (SM_KSLOT));
+        return;
+    }
+    set_entry(sm, i, &EMPTY);
+    if (sm->tags) {
+        sm->tags[i] = 0;
+    }
+    if (sm->ctrl) {
+        if (MATCH(sm->ctrl + i / GROUP * GROUP, CTRL_EMPTY)) {
+            sm->ctrl[i] = CTRL_EMPTY;
+        }
+        else {
+            sm->ctrl[i] = CTRL_DELETED;
+            ++(sm->deleted);
+        }
+    }
+}
+
+/*
+ * SM_DIRTY_LOG: slot `i` gets a key
+ */
+static void
+mark(STRMAP * sm, size_t i)
+{
+    if (sm->ndirty < sm->maxdirty) {
+        sm->dirty[(sm->ndirty)++] = i;
+    }
+}
+
+/*
+ * empty slot `i`, no tombstone
+ */
+static void
+reset(STRMAP * sm, size_t i)
+{
+    if (sm->it) {
+        memset(sm->it + i, 0, sizeof (SM_ISLOT));
+        return;
+    }
+    if (sm->ct) {
+        memset(sm->ct + i, 0, sizeof (SM_CSLOT));
+        return;
+    }
+    if (sm->kt) {
+        memset(sm->kt + i, 0, sizeof (SM_KSLOT));
+        return;
+    }
+    set_entry(sm, i, &EMPTY);
+    if (sm->tags) {
+        sm->tags[i] = 0;
+    }
+    if (sm->ctrl) {
+        sm->ctrl[i] = CTRL_EMPTY;
+    }
+}
+
+void
+compress(STRMAP * sm, size_t i)
+{
+    size_t empty, n, p;
+
+    empty = i;
+    if (++i == sm->capacity) {
+        i = 0;
+    }
+
+    while (used(sm, i)) {
+        n = distance(empty, i, sm->capacity);
+        if ((p = probes(sm, i)) >= n) {
+            /* swap current entry with empty */
+            move(sm, empty, i);
+            if (sm->dist) {
+                set_probes(sm, empty, p - n);
+            }
+            empty = i;
+        }
+        else if (sm->opt.flags & SM_ROBIN_HOOD) {
+            /* entries are ordered by root, none of the rest can move */
+            break;
+        }
+        if (++i == sm->capacity) {
+            i = 0;
+        }
+    }
+}
+
+STRMAP *grow(STRMAP * sm) {
+    STRMAP *map, *old;
+    
+    if (sm->size == MAX_SIZE) {
+        return 0;
+    }
+
+    if (sm->opt.flags & SM_INCREMENTAL) {
+        if (sm->old) {
+            /* new table is full before migration end */
+            migrate(sm, sm->old->capacity);
+        }
+        /* keys stay in the old table, later operations move them */
+        if (!(map = sm_create_ex((sm->size) * GROW_FACTOR, &sm->opt))) {
+            return 0;
+        }
+        if (!(old = (STRMAP *) allocate(sm, sizeof (STRMAP)))) {
+            sm_free(map);
+            return 0;
+        }
+        *old = *sm;
+        /* moved keys keep their copies, the arena stays with the map,
+           old table shares it */
+        map->arena = sm->arena;
+        sm->arena = 0;
+        sm->old = old;
+        sm->cursor = 0;
+        adopt(sm, map);
+        return sm;
+    }
+
+    return resize(sm, (size_t)((double)sm->size * GROW_FACTOR));
+}
+
+/*
+ * replace tables with new ones for at least `size` keys
+ */
+STRMAP *
+rehash(STRMAP * sm, size_t size)
+{
+    STRMAP *map;
+
+    if (!(map = transplant(sm, size, 0))) {
+        return 0;
+    }
+    if (sm->old) {
+        free_old(sm);
+    }
+    /* SM_OWN_KEYS copies stay where they are, the arena moves along */
+    sm->arena = 0;
+    if (!drop_table(sm)) {
+        sm->arena = map->arena;
+        map->arena = 0;
+        sm_free(map);
+        return 0;
+    }
+    adopt(sm, map);
+
+    return sm;
+}
+
+/*
+ * grow to at least `size` keys, SM_INPLACE_GROW: reallocated table
+ * unless it is mapped or allocator has no realloc
+ */
+STRMAP *
+resize(STRMAP * sm, size_t size)
+{
+    if ((sm->opt.flags & SM_INPLACE_GROW) && !sm->mapped
+        && sm->opt.alloc->realloc) {
+        return expand(sm, size);
+    }
+    return rehash(sm, size);
+}
+
+/*
+ * reallocate table for at least `size` keys and move entries to their
+ * new positions; needs a bitmap only, not a second table
+ */
+STRMAP *
+expand(STRMAP * sm, size_t size)
+{
+    unsigned char *done;
+    char *table;
+    size_t msize, capacity, bytes, values, log, slot, old, offset;
+
+    if (!sm_dimension(sm->opt.flags, size, &msize, &capacity)
+        || !(bytes = layout(&sm->opt, capacity, &values, &log))) {
+        return 0;
+    }
+    if (!(done = (unsigned char *) allocate(sm, capacity / CHAR_BIT + 1))) {
+        return 0;
+    }
+    memset(done, 0, capacity / CHAR_BIT + 1);
+    table = (char *) (sm->it ? (void *)sm->it : sm->ct ? (void *)sm->ct
+                      : sm->kt ? (void *)sm->kt : (void *)sm->ht);
+    offset = (size_t)(sm->values ? sm->values - table : 0);
+    table = (char *) sm->opt.alloc->realloc(sm->opt.alloc->ctx, table, bytes);
+    if (!table) {
+        release(sm, done);
+        return 0;
+    }
+
+    /* values follow the larger slot array, new slots and spare ones
+       are empty */
+    old = sm->capacity;
+    slot = slot_size(sm->opt.flags);
+    if (sm->values) {
+        memmove(table + values, table + offset,
+                (old + SPARE_SLOTS) * sm->opt.value_size);
+        sm->values = table + values;
+    }
+    memset(table + old * slot, 0, (capacity + SPARE_SLOTS - old) * slot);
+    if (sm->it) {
+        sm->it = (SM_ISLOT *) table;
+    }
+    else if (sm->ct) {
+        sm->ct = (SM_CSLOT *) table;
+    }
+    else if (sm->kt) {
+        sm->kt = (SM_KSLOT *) table;
+    }
+    else {
+        sm->ht = (SM_ENTRY *) table;
+    }
+    sm->capacity = capacity;
+    sm->msize = msize;
+    if (sm->maxdirty) {
+        /* every slot may be written, next clear is a full one */
+        sm->maxdirty = capacity / DIRTY_RATIO + 1;
+        sm->dirty = (size_t *) table + log;
+        sm->ndirty = sm->maxdirty;
+    }
+
+    redistribute(sm, old, done);
+    release(sm, done);
+
+    return sm;
+}
+
+/*
+ * place entries of first `old` slots for new capacity; placed entries
+ * are marked in `done` and never move again, an unplaced entry in the
+ * way is swapped out and placed next
+ */
+void
+redistribute(STRMAP * sm, size_t old, unsigned char *done)
+{
+    size_t i, j, tmp, swap;
+
+    tmp = sm->capacity;
+    swap = tmp + 1;
+    for (i = 0; i < old; ++i) {
+        if (!used(sm, i) || (done[i / CHAR_BIT] >> (i % CHAR_BIT) & 1)) {
+            continue;
+        }
+        move(sm, tmp, i);
+        for (;;) {
+            j = POSITION(sm, stored_hash(sm, tmp));
+            while (used(sm, j) && (done[j / CHAR_BIT] >> (j % CHAR_BIT) & 1)) {
+                if (++j == sm->capacity) {
+                    j = 0;
+                }
+            }
+            done[j / CHAR_BIT] |= (unsigned char)(1u << (j % CHAR_BIT));
+            if (!used(sm, j)) {
+                move(sm, j, tmp);
+                break;
+            }
+            move(sm, swap, j);
+            move(sm, j, tmp);
+            move(sm, tmp, swap);
+        }
+    }
+}
+
+/*
+ * sm_build: store key unless present; 1 - stored, 0 - duplicate,
+ * -1 - key can not be stored
+ */
+int
+place(STRMAP * sm, const char *key, size_t len, const void *data,
+      size_t hash)
+{
+    size_t i;
+
+    if (find(sm, key, len, hash, &i)) {
+        return 0;
+    }
+    if (!(key = own(sm, key, len))) {
+        return -1;
+    }
+    put(sm, i, key, len, data, hash);
+    ++(sm->size);
+    return 1;
 }
 
 /*
- * find entry with given key and hash in collision chain or return first
- * empty
+ * run `step` on every worker, the calling thread is worker 0 and runs
+ * those whose thread can not be started
  */
-SM_ENTRY *
-find(const STRMAP * sm, const char *key, size_t hash)
+void
+run(SM_BUILD * b, SM_BUILDER * w, void (*step) (SM_BUILDER * w))
 {
-    SM_ENTRY *entry, *stop;
+#ifdef THREADS
+    pthread_t threads[BUILD_THREADS];
+    int started[BUILD_THREADS];
+#endif
+    unsigned int t;
+
+    for (t = 0; t < b->threads; ++t) {
+        w[t].b = b;
+        w[t].id = t;
+        w[t].step = step;
+    }
+#ifdef THREADS
+    for (t = 1; t < b->threads; ++t) {
+        started[t] = !pthread_create(threads + t, 0, build_thread, w + t);
+    }
+    step(w);
+    for (t = 1; t < b->threads; ++t) {
+        if (started[t]) {
+            pthread_join(threads[t], 0);
+        }
+        else {
+            step(w + t);
+        }
+    }
+#else
+    for (t = 0; t < b->threads; ++t) {
+        step(w + t);
+    }
+#endif
+}
 
-    entry = sm->ht + POSITION(hash, sm->capacity);
-    stop = sm->ht + sm->capacity;
+#ifdef THREADS
+void *
+build_thread(void *arg)
+{
+    SM_BUILDER *w = (SM_BUILDER *) arg;
 
-    while (entry->key) {
-        if (hash == entry->hash) {
-            if (!strcmp(key, entry->key)) {
-                return entry;
+    w->step(w);
+    return 0;
+}
+#endif
+
+/*
+ * hash slice `id` of the keys and count them by home region
+ */
+void
+hash_keys(SM_BUILDER * w)
+{
+    SM_BUILD *b = w->b;
+    size_t *counts = b->counts + w->id * b->stride;
+    size_t i, stop;
+
+    i = b->n * w->id / b->threads;
+    stop = b->n * (w->id + 1) / b->threads;
+    for (; i < stop; ++i) {
+        b->lens[i] = strlen(b->keys[i]);
+        b->hashes[i] = key_hash(b->sm, b->keys[i], b->lens[i]);
+        if (b->regions) {
+            ++counts[POSITION(b->sm, b->hashes[i]) / b->width];
+        }
+    }
+}
+
+/*
+ * write indexes of slice `id` at their region offsets
+ */
+void
+scatter_keys(SM_BUILDER * w)
+{
+    SM_BUILD *b = w->b;
+    size_t *offsets = b->counts + w->id * b->stride;
+    size_t i, stop;
+
+    i = b->n * w->id / b->threads;
+    stop = b->n * (w->id + 1) / b->threads;
+    for (; i < stop; ++i) {
+        b->order[offsets[POSITION(b->sm, b->hashes[i]) / b->width]++] = i;
+    }
+}
+
+/*
+ * linear probing confined to region `id`, so threads write disjoint
+ * slots; a key reaching the region end is moved to the front of the
+ * region order range and stored later by the calling thread; keys are
+ * stored as given, SM_OWN_KEYS maps are not filled by regions
+ */
+void
+fill_region(SM_BUILDER * w)
+{
+    SM_BUILD *b = w->b;
+    STRMAP *sm = b->sm;
+    size_t k, i, j, end, placed = 0, spilled = 0;
+
+    end = (w->id + 1) * b->width;
+    end = (end < sm->capacity ? end : sm->capacity);
+    for (k = b->bounds[w->id]; k < b->bounds[w->id + 1]; ++k) {
+        i = b->order[k];
+        if (sm->kt && b->lens[i] > UINT_MAX) {
+            /* no SM_KEYS_ONLY slot for it, place() of the calling
+               thread fails the build */
+            b->order[b->bounds[w->id] + spilled++] = i;
+            continue;
+        }
+        for (j = POSITION(sm, b->hashes[i]); j < end; ++j) {
+            if (!used(sm, j)) {
+                put(sm, j, b->keys[i], b->lens[i],
+                    b->datas ? b->datas[i] : 0, b->hashes[i]);
+                ++placed;
+                break;
             }
+            if (equal(sm, j, b->keys[i], b->lens[i], b->hashes[i])) {
+                break;
+            }
+        }
+        if (j == end) {
+            b->order[b->bounds[w->id] + spilled++] = i;
         }
+    }
+    w->placed = placed;
+    w->spilled = spilled;
+}
 
-        if (++entry == stop) {
-            entry = sm->ht;
+/*
+ * capacity and max size for at least `size` keys, 0 on overflow
+ */
+int
+sm_dimension(unsigned int flags, size_t size, size_t * msize,
+             size_t * capacity)
+{
+    size_t n, c;
+
+    n = (size < MIN_SIZE ? MIN_SIZE : size);
+    n = (n > MAX_SIZE ? MAX_SIZE : n);
+    if (flags & SM_SWISS) {
+        /* power of two number of groups, 7/8 max load */
+        for (c = GROUP; c - c / 8 < n; c <<= 1) {
+            if (c > MAX_SIZE / 2) {
+                return 0;
+            }
+        }
+        n = c - c / 8;
+    }
+    else if (flags & SM_POW2) {
+        /* max size follows power of two capacity */
+        for (c = 8; (size_t)((double)c * LOAD_FACTOR) < n; c <<= 1) {
+            if (c > MAX_SIZE / 2) {
+                return 0;
+            }
         }
+        n = (size_t)((double)c * LOAD_FACTOR);
+    }
+    else {
+        c = (size_t)((double)n / LOAD_FACTOR);
+        c = adjust(c);
+    }
+
+    assert(n < c);
+    *msize = n;
+    *capacity = c;
+    return 1;
+}
+
+/*
+ * table bytes, 0 on overflow; tags and control bytes share one
+ * allocation with the entries, values follow at byte offset `values`,
+ * SM_DIRTY_LOG log at size_t index `log`
+ */
+size_t
+layout(const SM_OPTIONS * opt, size_t capacity, size_t * values, size_t * log)
+{
+    size_t slot, slots, maxdirty, bytes;
+    unsigned int flags = opt->flags;
+
+    slot = slot_size(flags);
+    if (flags & SM_SPLIT) {
+        slot += sizeof (unsigned int);
+    }
+    if (flags & (SM_SWISS | SM_ROBIN_HOOD)) {
+        slot += sizeof (unsigned char);
     }
+    slots = capacity + (flags & SM_INPLACE_GROW ? SPARE_SLOTS : 0);
+    maxdirty = (flags & SM_DIRTY_LOG ? capacity / DIRTY_RATIO + 1 : 0);
+    if (opt->value_size > ((size_t)-1) / 4 / slots
+        || slots > ((size_t)-1) / 4 / slot - maxdirty - VALUE_ALIGN) {
+        return 0;
+    }
+    bytes = slots * slot;
+    *values = (bytes + VALUE_ALIGN - 1) / VALUE_ALIGN * VALUE_ALIGN;
+    bytes = *values + slots * opt->value_size;
+    *log = (bytes + sizeof (size_t) - 1) / sizeof (size_t);
+    return (*log + maxdirty) * sizeof (size_t);
+}
 
-    return entry;
+/*
+ * value_size: in-table value of slot `i`
+ */
+char *
+value(const STRMAP * sm, size_t i)
+{
+    return sm->values + i * sm->opt.value_size;
 }
 
+/*
+ * value_size: copy value into slot `i`, NULL - zero value
+ */
 void
-compress(STRMAP * sm, SM_ENTRY * entry)
+store(STRMAP * sm, size_t i, const void *data)
 {
-    SM_ENTRY *empty, *root, *stop;
+    if (data) {
+        memcpy(value(sm, i), data, sm->opt.value_size);
+    }
+    else {
+        memset(value(sm, i), 0, sm->opt.value_size);
+    }
+}
 
-    empty = entry;
-    stop = sm->ht + sm->capacity;
-    if (++entry == stop) {
-        entry = sm->ht;
+/*
+ * entry bytes without tags and control bytes
+ */
+size_t
+slot_size(unsigned int flags)
+{
+    if (flags & SM_COMPACT) {
+        return sizeof (SM_CSLOT);
     }
+    if (flags & SM_KEYS_ONLY) {
+        return sizeof (SM_KSLOT);
+    }
+    return (flags & SM_INLINE_KEYS ? sizeof (SM_ISLOT) : sizeof (SM_ENTRY));
+}
 
-    while (entry->key) {
-        root = sm->ht + POSITION(entry->hash, sm->capacity);
-        if (distance(root, entry, sm->capacity) >=
-            distance(empty, entry, sm->capacity)) {
-            /* swap current entry with empty */
-            *empty = *entry;
-            *entry = EMPTY;
-            empty = entry;
+/*
+ * low water mark reached, shrink if max size halves at least;
+ * on allocation failure the map stays as is
+ */
+void
+shrink(STRMAP * sm)
+{
+    size_t size;
+
+    size = (size_t)((double)sm->size * GROW_FACTOR);
+    if ((size < MIN_SIZE ? MIN_SIZE : size) <= sm->msize / 2) {
+        rehash(sm, size);
+    }
+}
+
+/*
+ * take over tables of `map` and free it
+ */
+void
+adopt(STRMAP * sm, STRMAP * map)
+{
+    arena_release(sm, sm->arena);
+    sm->arena = map->arena;
+    set_table(sm, map->ht, map->capacity);
+    sm->it = map->it;
+    sm->ct = map->ct;
+    sm->kt = map->kt;
+    sm->tags = map->tags;
+    sm->ctrl = map->ctrl;
+    sm->dist = map->dist;
+    sm->deleted = map->deleted;
+    sm->msize = map->msize;
+    sm->mapped = map->mapped;
+    sm->dirty = map->dirty;
+    sm->ndirty = map->ndirty;
+    sm->maxdirty = map->maxdirty;
+    sm->values = map->values;
+    release(sm, map);
+}
+
+/*
+ * free old table, its keys are in the map arena
+ */
+void
+free_old(STRMAP * sm)
+{
+    sm->old->arena = 0;
+    sm_free(sm->old);
+    sm->old = 0;
+}
+
+/*
+ * table holding key or NULL, `slot` receives entry of found key or
+ * insertion point in the new table
+ */
+STRMAP *
+locate(STRMAP * sm, const char *key, size_t len, size_t hash, size_t * slot)
+{
+    size_t i;
+
+    if (find(sm, key, len, hash, slot)) {
+        return sm;
+    }
+    if (sm->old && find(sm->old, key, len, hash, &i)) {
+        *slot = i;
+        return sm->old;
+    }
+    return 0;
+}
+
+/*
+ * move at least `n` old table slots to the new one; stops only at an
+ * empty slot, so no collision chain of the old table is cut
+ */
+void
+migrate(STRMAP * sm, size_t n)
+{
+    STRMAP *old = sm->old;
+
+    while (sm->cursor < old->capacity && old->size) {
+        if (!n && (old->ctrl || !used(old, sm->cursor))) {
+            return;
         }
-        if (++entry == stop) {
-            entry = sm->ht;
+        if (used(old, sm->cursor)) {
+            transfer(sm, sm->cursor);
+        }
+        ++(sm->cursor);
+        if (n) {
+            --n;
         }
     }
+
+    free_old(sm);
 }
 
-STRMAP *grow(STRMAP * sm) {
-    STRMAP *map;
-    
-    if (sm->size == MAX_SIZE) {
+/*
+ * move old table entry `i` into the new table
+ */
+void
+transfer(STRMAP * sm, size_t i)
+{
+    SM_ENTRY item;
+    size_t slot;
+
+    view(sm->old, i, &item);
+    find(sm, item.key, item.len, item.hash, &slot);
+    put(sm, slot, item.key, item.len, item.data, item.hash);
+    erase(sm->old, i);
+    --(sm->old->size);
+}
+
+/*
+ * old table slot `i` was emptied, move out the rest of its run
+ */
+void
+evacuate(STRMAP * sm, size_t i)
+{
+    STRMAP *old = sm->old;
+
+    if (old->ctrl) {
+        return;
+    }
+    for (;;) {
+        if (++i == old->capacity) {
+            i = 0;
+        }
+        if (!used(old, i)) {
+            break;
+        }
+        transfer(sm, i);
+    }
+}
+
+/*
+ * key to store: SM_OWN_KEYS copy in the arena, NULL if out of memory;
+ * short SM_INLINE_KEYS keys are copied into the slot anyway
+ */
+const char *
+own(STRMAP * sm, const char *key, size_t len)
+{
+    SM_ARENA *arena;
+    char *copy;
+    unsigned int head[2];
+    size_t offset;
+
+    if (sm->kt && len > UINT_MAX) {
         return 0;
     }
-    
-    if (!(map = sm_create_from(sm, (sm->size) * GROW_FACTOR))) {
-       return 0; 
+    if (!(sm->opt.flags & SM_OWN_KEYS) || (sm->it && len < INLINE_TAG)) {
+        return key;
+    }
+    if (!sm->arena) {
+        if (!(sm->arena = (SM_ARENA *) allocate(sm, sizeof (SM_ARENA)))) {
+            return 0;
+        }
+        memset(sm->arena, 0, sizeof (SM_ARENA));
+    }
+    if (sm->ct) {
+        /* reference and length header */
+        if (len > UINT_MAX - KEY_HEADER - 1
+            || !(copy = arena_alloc(sm, KEY_HEADER + len + 1))) {
+            return 0;
+        }
+        arena = sm->arena;
+        copy += KEY_HEADER;
+        offset = (size_t)(copy - arena->chunks[arena->last]);
+        assert(arena->last < MAX_CHUNKS);
+        assert(offset <= 0xffff);
+        head[0] = (unsigned int)((arena->last + 1) << 16 | offset);
+        head[1] = (unsigned int)len;
+        memcpy(copy - KEY_HEADER, head, KEY_HEADER);
+    }
+    else if (!(copy = arena_alloc(sm, len + 1))) {
+        return 0;
     }
+    memcpy(copy, key, len);
+    copy[len] = 0;
 
-    free(sm->ht);
-    sm->ht = map->ht;
-    sm->msize = map->msize;
-    sm->capacity = map->capacity;
-    free(map);
-    
-    return sm;
+    return copy;
+}
+
+/*
+ * bump allocation, large blocks get own directory entry; SM_COMPACT
+ * references no more than MAX_CHUNKS chunks, none is opened past it
+ */
+char *
+arena_alloc(STRMAP * sm, size_t n)
+{
+    SM_ARENA *arena = sm->arena;
+    char **chunks, *chunk;
+    size_t slots, size;
+
+    if (n <= arena->left) {
+        arena->left -= n;
+        arena->top += n;
+        arena->last = arena->current;
+        return arena->top - n;
+    }
+    if (sm->ct && arena->count >= MAX_CHUNKS) {
+        return 0;
+    }
+    if (arena->count == arena->slots) {
+        slots = (arena->slots ? 2 * arena->slots : 16);
+        if (!(chunks = (char **) allocate(sm, slots * sizeof (char *)))) {
+            return 0;
+        }
+        if (arena->count) {
+            memcpy(chunks, arena->chunks, arena->count * sizeof (char *));
+        }
+        release(sm, arena->chunks);
+        arena->chunks = chunks;
+        arena->slots = slots;
+    }
+    size = (n > ARENA_CHUNK / 4 ? n : ARENA_CHUNK);
+    if (!(chunk = (char *) allocate(sm, size))) {
+        return 0;
+    }
+    arena->last = arena->count;
+    arena->chunks[arena->count++] = chunk;
+    arena->bytes += size;
+    if (size == ARENA_CHUNK) {
+        arena->top = chunk + n;
+        arena->left = size - n;
+        arena->current = arena->last;
+    }
+
+    return chunk;
+}
+
+void
+arena_release(const STRMAP * sm, SM_ARENA * arena)
+{
+    size_t i;
+
+    if (arena) {
+        for (i = 0; i < arena->count; ++i) {
+            release(sm, arena->chunks[i]);
+        }
+        release(sm, arena->chunks);
+        release(sm, arena);
+    }
+}
+
+/*
+ * zero filled table, SM_HUGE_PAGES: large one mapped at huge page
+ * boundary, `mapped` receives its size; otherwise from the allocator
+ */
+void *
+table_alloc(const SM_ALLOCATOR * mem, unsigned int flags, size_t size,
+            size_t * mapped)
+{
+#ifdef HUGE_PAGES
+    char *base, *table;
+    size_t head;
+
+    if ((flags & SM_HUGE_PAGES) && size >= HUGE_PAGE
+        && size <= ((size_t)-1) - 2 * HUGE_PAGE) {
+        size = (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+        /* over map by one huge page and trim to alignment */
+        base = (char *) mmap(0, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base != (char *) MAP_FAILED) {
+            table = (char *) (((size_t)base + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+            head = (size_t)(table - base);
+            if (head) {
+                munmap(base, head);
+            }
+            if (head != HUGE_PAGE) {
+                munmap(table + size, HUGE_PAGE - head);
+            }
+            /* advice only, transparent huge pages may be disabled */
+            madvise(table, size, MADV_HUGEPAGE);
+            *mapped = size;
+            return table;
+        }
+    }
+#else
+    (void)flags;
+#endif
+    *mapped = 0;
+    return mem->zalloc(mem->ctx, size);
+}
+
+void
+table_free(const SM_ALLOCATOR * mem, void *table, size_t mapped)
+{
+#ifdef HUGE_PAGES
+    if (mapped) {
+        munmap(table, mapped);
+        return;
+    }
+#else
+    assert(!mapped);
+#endif
+    if (table) {
+        mem->free(mem->ctx, table);
+    }
+}
+
+void
+release_table(const STRMAP * sm)
+{
+    table_free(sm->opt.alloc, table_base(sm), sm->mapped);
+}
+
+/*
+ * start of the table allocation
+ */
+void *
+table_base(const STRMAP * sm)
+{
+    return (sm->it ? (void *)sm->it : sm->ct ? (void *)sm->ct
+            : sm->kt ? (void *)sm->kt : (void *)sm->ht);
+}
+
+/*
+ * SM_SEQLOCK: keep table (`table` non zero) and keys until sm_reclaim,
+ * a lookup may still read them; 0 - no memory, nothing is retired
+ */
+int
+retire(STRMAP * sm, int table)
+{
+    SM_RETIRED *r;
+    size_t values, log;
+
+    if (!table && !sm->arena) {
+        return 1;
+    }
+    if (!(r = (SM_RETIRED *) allocate(sm, sizeof (SM_RETIRED)))) {
+        return 0;
+    }
+    r->table = (table ? table_base(sm) : 0);
+    r->mapped = (table ? sm->mapped : 0);
+    r->bytes = (!table ? 0 : sm->mapped ? sm->mapped
+                : layout(&sm->opt, sm->capacity, &values, &log));
+    r->arena = sm->arena;
+    sm->arena = 0;
+    r->next = sm->retired;
+    sm->retired = r;
+    return 1;
+}
+
+/*
+ * give up the table before adopt; 0 - SM_SEQLOCK table can not be
+ * retired
+ */
+int
+drop_table(STRMAP * sm)
+{
+    if (sm->opt.flags & SM_SEQLOCK) {
+        return retire(sm, 1);
+    }
+    release_table(sm);
+    return 1;
+}
+
+/*
+ * blocks of the map allocator
+ */
+void *
+allocate(const STRMAP * sm, size_t size)
+{
+    return sm->opt.alloc->alloc(sm->opt.alloc->ctx, size);
+}
+
+void
+release(const STRMAP * sm, void *ptr)
+{
+    if (ptr) {
+        sm->opt.alloc->free(sm->opt.alloc->ctx, ptr);
+    }
+}
+
+void *
+sm_allocate(const SM_ALLOCATOR * alloc, size_t size)
+{
+    return alloc ? alloc->alloc(alloc->ctx, size) : malloc(size);
+}
+
+void
+sm_release(const SM_ALLOCATOR * alloc, void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    if (alloc) {
+        alloc->free(alloc->ctx, ptr);
+    }
+    else {
+        free(ptr);
+    }
+}
+
+/*
+ * default allocator
+ */
+void *
+std_alloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return malloc(size);
 }
 
+void *
+std_zalloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return calloc(1, size);
+}
+
+void *
+std_realloc(void *ctx, void *ptr, size_t size)
+{
+    (void)ctx;
+    return realloc(ptr, size);
+}
 
-#undef POSITION
+void
+std_free(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
+}
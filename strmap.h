@@ -45,9 +45,12 @@
 typedef struct STRMAP STRMAP;
 
 typedef struct SM_ENTRY {
-    const char *key;            /* C null terminated string */
+    const char *key;            /* key bytes, null terminated unless _n API;
+                                   SM_INLINE_KEYS short key is in the slot,
+                                   valid until the map is modified */
     const void *data;           /* user data */
     size_t hash;                /* key hash value */
+    size_t len;                 /* key length */
 } SM_ENTRY;
 
 typedef enum SM_RESULT {
@@ -61,6 +64,55 @@ typedef enum SM_RESULT {
     SM_REMOVED = 4
 } SM_RESULT;
 
+typedef enum SM_FLAGS {
+    SM_DEFAULT = 0,
+    SM_SPLIT = 1,               /* hash tags in a separate dense array */
+    SM_SWISS = 2,               /* control bytes, SIMD group probing */
+    SM_ROBIN_HOOD = 4,          /* entries ordered by probe distance */
+    SM_POW2 = 8,                /* power of two capacity, mask reduction */
+    SM_INLINE_KEYS = 16,        /* keys shorter than 15 bytes in the slot */
+    SM_INCREMENTAL = 32,        /* grow by migrating keys in later calls */
+    SM_OWN_KEYS = 64,           /* inserted keys are copied into map arena */
+    SM_HUGE_PAGES = 128,        /* large tables on 2 MB aligned huge pages */
+    SM_COMPACT = 256,           /* 32 bit key reference and hash slots,
+                                   requires SM_OWN_KEYS */
+    SM_DIRTY_LOG = 512,         /* sm_clear resets written slots only */
+    SM_INPLACE_GROW = 1024,     /* grow by reallocating the table */
+    SM_KEYS_ONLY = 2048,        /* 16 byte slots without data, see strset.h */
+    SM_SEQLOCK = 4096           /* lookups concurrent with one writer */
+} SM_FLAGS;
+
+/* key hash function, `key` is `len` bytes */
+typedef size_t (*SM_HASH) (const char *key, size_t len);
+
+/* memory hooks, `ctx` is passed to each call; free never gets NULL */
+typedef struct SM_ALLOCATOR {
+    void *(*alloc) (void *ctx, size_t size);
+    void *(*zalloc) (void *ctx, size_t size);   /* zero filled block */
+    void *(*realloc) (void *ctx, void *ptr, size_t size);  /* may be NULL */
+    void (*free) (void *ctx, void *ptr);
+    void *ctx;
+} SM_ALLOCATOR;
+
+typedef struct SM_OPTIONS {
+    unsigned int flags;         /* bitwise OR of SM_FLAGS */
+    SM_HASH hash;               /* NULL - poly_hashn */
+    unsigned int shrink;        /* shrink when load falls below shrink % of
+                                   max load, 0 - never */
+    const SM_ALLOCATOR *alloc;  /* NULL - malloc, calloc and free; must
+                                   outlive the map */
+    size_t value_size;          /* 0 - user data pointers, otherwise
+                                   bytes of value stored in the map */
+} SM_OPTIONS;
+
+typedef struct SM_MEMORY {
+    size_t table;               /* slots, tags, control bytes, dirty log */
+    size_t map;                 /* map structures */
+    size_t keys;                /* SM_OWN_KEYS arena */
+    size_t total;
+    double per_key;             /* total / size, 0 - empty map */
+} SM_MEMORY;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -70,8 +122,37 @@ extern "C" {
 */
     STRMAP *sm_create(size_t size);
 
+/**
+  @brief Create a string map with given options, `opts` may be NULL
+  @return map or NULL with errno set to ENOMEM or EINVAL
+*/
+    STRMAP *sm_create_ex(size_t size, const SM_OPTIONS * opts);
+
+/**
+  @brief Create a string map with the same options as `sm` and copy its keys
+*/
     STRMAP *sm_create_from(const STRMAP * sm, size_t size);
 
+/**
+  @brief Create a string map holding `keys[0]` .. `keys[n - 1]` with data
+  `datas[i]` (`datas` may be NULL), up to `nthreads` threads hash the keys
+  and fill disjoint regions of the table; a repeated key keeps its first
+  data
+  @return map or NULL with errno set to ENOMEM
+*/
+    STRMAP *sm_build(const char *const *keys, const void *const *datas,
+                     size_t n, unsigned int nthreads);
+
+/**
+  @brief sm_build with given options, `opts` may be NULL; SM_SWISS,
+  SM_ROBIN_HOOD, SM_OWN_KEYS and SM_DIRTY_LOG maps are filled by the
+  calling thread from hashes computed in parallel
+  @return map or NULL with errno set to ENOMEM or EINVAL
+*/
+    STRMAP *sm_build_ex(const char *const *keys, const void *const *datas,
+                        size_t n, unsigned int nthreads,
+                        const SM_OPTIONS * opts);
+
 /**
   @brief Retrieves user associated data for given key
   @return SM_FOUND on success, SM_NOT_FOUND otherwise
@@ -110,11 +191,43 @@ extern "C" {
 */
     SM_RESULT sm_remove(STRMAP * sm, const char *key, SM_ENTRY * item);
 
+/**
+  @brief Length aware variants, `key` is `len` bytes and need not be null terminated
+*/
+    SM_RESULT sm_lookup_n(const STRMAP * sm, const char *key, size_t len,
+                          SM_ENTRY * item);
+    SM_RESULT sm_insert_n(STRMAP * sm, const char *key, size_t len,
+                          const void *data, SM_ENTRY * item);
+    SM_RESULT sm_update_n(STRMAP * sm, const char *key, size_t len,
+                          const void *data, SM_ENTRY * item);
+    SM_RESULT sm_upsert_n(STRMAP * sm, const char *key, size_t len,
+                          const void *data, SM_ENTRY * item);
+    SM_RESULT sm_remove_n(STRMAP * sm, const char *key, size_t len,
+                          SM_ENTRY * item);
+
 /**
   @brief For each callback
 */
     void sm_foreach(const STRMAP * sm, void (*action) (SM_ENTRY item, void *ctx), void *ctx);
 
+/**
+  @brief Value of key in the map created with `value_size`
+  @return pointer to the value, valid until the next modification, or NULL
+*/
+    void *sm_value(const STRMAP * sm, const char *key);
+    void *sm_value_n(const STRMAP * sm, const char *key, size_t len);
+
+/**
+  @brief Value of key in the map created with `value_size`, zero filled
+  value is inserted if key not exists; `result` (may be NULL) receives
+  SM_FOUND or SM_INSERTED
+  @return pointer to the value, valid until the next modification, or NULL
+  if map is full
+*/
+    void *sm_emplace(STRMAP * sm, const char *key, SM_RESULT * result);
+    void *sm_emplace_n(STRMAP * sm, const char *key, size_t len,
+                       SM_RESULT * result);
+
 /**
   @brief Remove all keys
 */
@@ -125,10 +238,39 @@ extern "C" {
 */
     size_t sm_size(const STRMAP * sm);
 
+/**
+  @brief Rehash so that `size` keys fit without growth
+  @return 0 on success, -1 with errno set to ENOMEM otherwise
+*/
+    int sm_reserve(STRMAP * sm, size_t size);
+
+/**
+  @brief Rehash into the smallest table holding current keys
+  @return 0 on success, -1 with errno set to ENOMEM otherwise
+*/
+    int sm_shrink_to_fit(STRMAP * sm);
+
+/**
+  @brief SM_INCREMENTAL: non zero while keys move from the previous table
+*/
+    int sm_migrating(const STRMAP * sm);
+
     double sm_probes_mean(const STRMAP * sm);
     double sm_probes_var(const STRMAP * sm);
     double sm_load_factor(const STRMAP * sm);
 
+/**
+  @brief SM_SEQLOCK: free tables and keys replaced while lookups might
+  read them; no lookup may run during the call
+*/
+    void sm_reclaim(STRMAP * sm);
+
+/**
+  @brief Bytes allocated for the map, `usage` may be NULL
+  @return total bytes
+*/
+    size_t sm_memory_usage(const STRMAP * sm, SM_MEMORY * usage);
+
 /**
   @brief Remove all keys and free memory allocated for the map structure
 */
@@ -136,6 +278,18 @@ extern "C" {
 
     size_t poly_hashs(const char *key);
 
+/**
+  @brief Polynomial hash of `len` bytes, equals poly_hashs() for C strings
+*/
+    size_t poly_hashn(const char *key, size_t len);
+
+/**
+  @brief Built-in SM_OPTIONS hash functions: wyhash style multiply-fold
+  (16 bytes per step) and CRC32C (SSE4.2 instruction when compiled for it)
+*/
+    size_t sm_hash_wy(const char *key, size_t len);
+    size_t sm_hash_crc32c(const char *key, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,420 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file strmap.hpp
+  @brief STRMAP C++ front-end, header only; hash, key equality, value type
+  and table layout are template parameters, so probe loops are compiled
+  for each combination and callbacks inline
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#ifndef _STRMAP_HPP
+#define _STRMAP_HPP
+
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "strmap.h"
+#include "strmap_int.h"
+
+namespace sm {
+
+/* hash policies, same values as the C map with the same SM_HASH */
+struct poly_hash {
+    size_t operator() (const char *key, size_t len) const {
+        return poly_hashn(key, len);
+    }
+};
+
+struct wy_hash {
+    size_t operator() (const char *key, size_t len) const {
+        return sm_hash_wy(key, len);
+    }
+};
+
+struct crc32c_hash {
+    size_t operator() (const char *key, size_t len) const {
+        return sm_hash_crc32c(key, len);
+    }
+};
+
+/* key equality policy, called on hash and length match */
+struct key_equal {
+    bool operator() (const char *a, const char *b, size_t len) const {
+        return !std::memcmp(a, b, len);
+    }
+};
+
+/* table dimension of the C map with `flags` */
+inline void dimension_of(unsigned int flags, size_t size, size_t & msize,
+                         size_t & capacity) {
+    if (size > ((size_t)-1) / 4
+        || !sm_dimension(flags, size, &msize, &capacity)) {
+        throw std::length_error("strmap size");
+    }
+}
+
+/*
+ * layout policies: home slot of a hash, table dimension for a number of
+ * keys (max size, capacity), `ordered` - Robin Hood insertion
+ */
+struct linear {
+    static const bool ordered = false;
+
+    static size_t position(size_t hash, size_t capacity) {
+        return hash % capacity;
+    }
+
+    static void dimension(size_t size, size_t & msize, size_t & capacity) {
+        dimension_of(SM_DEFAULT, size, msize, capacity);
+    }
+};
+
+/* SM_POW2: finalized hash masked by capacity - 1 */
+struct pow2 {
+    static const bool ordered = false;
+
+    static size_t position(size_t hash, size_t capacity) {
+        SM_MIX(hash);
+        return hash & (capacity - 1);
+    }
+
+    static void dimension(size_t size, size_t & msize, size_t & capacity) {
+        dimension_of(SM_POW2, size, msize, capacity);
+    }
+};
+
+/* SM_ROBIN_HOOD on top of another layout */
+template <class Base>
+struct robin_hood_on : Base {
+    static const bool ordered = true;
+};
+
+typedef robin_hood_on<linear> robin_hood;
+
+/**
+  @brief Open addressing string map, keys are borrowed (must outlive the
+  map) as in the C default mode, values are stored in the slots
+*/
+template <class Value, class Hash = poly_hash, class Layout = linear,
+          class Equal = key_equal>
+class basic_strmap {
+public:
+    typedef Value value_type;
+
+    struct entry {
+        const char *key;        /* NULL - empty slot */
+        size_t len;
+        size_t hash;
+        Value value;
+    };
+
+    explicit basic_strmap(size_t size = 0,
+                          const Hash & hash = Hash(),
+                          const Equal & equal = Equal())
+        : size_(0), hash_(hash), equal_(equal) {
+        Layout::dimension(size, msize_, capacity_);
+        table_.resize(capacity_, empty());
+    }
+
+    /**
+      @brief Insert key and value
+      @return SM_INSERTED or SM_DUPLICATE
+    */
+    SM_RESULT insert(const char *key, size_t len, const Value & value) {
+        size_t h = hash_(key, len), i;
+
+        if (find(key, len, h, i)) {
+            return SM_DUPLICATE;
+        }
+        put(i, key, len, h, value);
+        return SM_INSERTED;
+    }
+
+    SM_RESULT insert(const char *key, const Value & value) {
+        return insert(key, std::strlen(key), value);
+    }
+
+    /**
+      @brief Update value of key or insert if key not exists
+      @return SM_UPDATED or SM_INSERTED
+    */
+    SM_RESULT upsert(const char *key, size_t len, const Value & value) {
+        size_t h = hash_(key, len), i;
+
+        if (find(key, len, h, i)) {
+            table_[i].value = value;
+            return SM_UPDATED;
+        }
+        put(i, key, len, h, value);
+        return SM_INSERTED;
+    }
+
+    SM_RESULT upsert(const char *key, const Value & value) {
+        return upsert(key, std::strlen(key), value);
+    }
+
+    /**
+      @brief Value of key, default constructed one inserted if key not exists
+    */
+    Value & operator[] (const char *key) {
+        size_t len = std::strlen(key), h = hash_(key, len), i;
+
+        if (!find(key, len, h, i)) {
+            i = put(i, key, len, h, Value());
+        }
+        return table_[i].value;
+    }
+
+    /**
+      @brief Value of key or NULL, valid until the next modification
+    */
+    Value *find(const char *key, size_t len) {
+        size_t i;
+
+        return find(key, len, hash_(key, len), i) ? &table_[i].value : 0;
+    }
+
+    const Value *find(const char *key, size_t len) const {
+        size_t i;
+
+        return find(key, len, hash_(key, len), i) ? &table_[i].value : 0;
+    }
+
+    Value *find(const char *key) {
+        return find(key, std::strlen(key));
+    }
+
+    const Value *find(const char *key) const {
+        return find(key, std::strlen(key));
+    }
+
+    /**
+      @brief Remove key, entries after it are shifted back (no tombstones)
+      @return SM_REMOVED or SM_NOT_FOUND
+    */
+    SM_RESULT remove(const char *key, size_t len) {
+        size_t i;
+
+        if (!find(key, len, hash_(key, len), i)) {
+            return SM_NOT_FOUND;
+        }
+        compress(i);
+        --size_;
+        return SM_REMOVED;
+    }
+
+    SM_RESULT remove(const char *key) {
+        return remove(key, std::strlen(key));
+    }
+
+    /**
+      @brief Call `action(const entry &)` for each key, inlined
+    */
+    template <class Action>
+    void for_each(Action action) const {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (table_[i].key) {
+                action(table_[i]);
+            }
+        }
+    }
+
+    void clear() {
+        table_.assign(capacity_, empty());
+        size_ = 0;
+    }
+
+    /**
+      @brief Rehash so that `size` keys fit without growth
+    */
+    void reserve(size_t size) {
+        if (size > msize_) {
+            rehash(size);
+        }
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    double load_factor() const {
+        return (double)size_ / (double)capacity_;
+    }
+
+    double probes_mean() const {
+        size_t total = 0;
+
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (table_[i].key) {
+                total += probes(i);
+            }
+        }
+        return size_ ? (double)total / (double)size_ : 0.0;
+    }
+
+private:
+    static entry empty() {
+        entry e;
+
+        e.key = 0;
+        e.len = e.hash = 0;
+        e.value = Value();
+        return e;
+    }
+
+    size_t distance(size_t from, size_t to) const {
+        return to >= from ? to - from : capacity_ - (from - to);
+    }
+
+    size_t probes(size_t i) const {
+        return distance(Layout::position(table_[i].hash, capacity_), i);
+    }
+
+    size_t next(size_t i) const {
+        return ++i == capacity_ ? 0 : i;
+    }
+
+    /* `slot` receives found entry or insertion point */
+    bool find(const char *key, size_t len, size_t h, size_t & slot) const {
+        size_t i = Layout::position(h, capacity_), d;
+        const entry *e;
+
+        for (d = 0; (e = &table_[i])->key; ++d, i = next(i)) {
+            if (h == e->hash && len == e->len && equal_(key, e->key, len)) {
+                slot = i;
+                return true;
+            }
+            if (Layout::ordered && probes(i) < d) {
+                break;
+            }
+        }
+        slot = i;
+        return false;
+    }
+
+    /* store at insertion point `i`, growing first if full; the value is
+       copied before the table changes, so a throwing copy leaves the map
+       as it was */
+    size_t put(size_t i, const char *key, size_t len, size_t h,
+               const Value & value) {
+        entry e;
+
+        e.key = key;
+        e.len = len;
+        e.hash = h;
+        e.value = value;
+        if (size_ == msize_) {
+            rehash((size_t)((double)size_ * SM_GROW_FACTOR));
+            find(key, len, h, i);
+        }
+        if (table_[i].key) {
+            displace(i);
+        }
+        table_[i] = std::move(e);
+        ++size_;
+        return i;
+    }
+
+    /* SM_ROBIN_HOOD: shift run from `i` one slot forward */
+    void displace(size_t i) {
+        size_t empty, prev;
+
+        for (empty = i; table_[empty].key; empty = next(empty)) {
+        }
+        while (empty != i) {
+            prev = (empty ? empty : capacity_) - 1;
+            table_[empty] = std::move(table_[prev]);
+            empty = prev;
+        }
+    }
+
+    /* Kolosovskiy backward shift deletion */
+    void compress(size_t i) {
+        size_t empty = i;
+
+        for (i = next(i); table_[i].key; i = next(i)) {
+            if (probes(i) >= distance(empty, i)) {
+                table_[empty] = std::move(table_[i]);
+                empty = i;
+            }
+            else if (Layout::ordered) {
+                break;
+            }
+        }
+        table_[empty] = basic_strmap::empty();
+    }
+
+    /* fill a new table, then take it over; entries are moved only when
+       that can not throw, so on an exception the map stays as it was */
+    void rehash(size_t size) {
+        basic_strmap fresh(size, hash_, equal_);
+        size_t i, j;
+
+        for (i = 0; i < capacity_; ++i) {
+            if (table_[i].key) {
+                fresh.find(table_[i].key, table_[i].len, table_[i].hash, j);
+                if (fresh.table_[j].key) {
+                    fresh.displace(j);
+                }
+                fresh.table_[j] = std::move_if_noexcept(table_[i]);
+            }
+        }
+        table_.swap(fresh.table_);
+        msize_ = fresh.msize_;
+        capacity_ = fresh.capacity_;
+    }
+
+    std::vector<entry> table_;
+    size_t size_;
+    size_t msize_;
+    size_t capacity_;
+    Hash hash_;
+    Equal equal_;
+};
+
+/* default policies */
+template <class Value>
+class strmap : public basic_strmap<Value> {
+public:
+    explicit strmap(size_t size = 0) : basic_strmap<Value>(size) {
+    }
+};
+
+}                               /* namespace sm */
+
+#endif
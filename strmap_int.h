@@ -0,0 +1,119 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file strmap_int.h
+  @brief STRMAP internals shared by the maps built on it, not a public
+  interface
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#ifndef _STRMAP_INT_H
+#define _STRMAP_INT_H
+
+#include <limits.h>
+
+#include "strmap.h"
+
+/*
+ * hash finalizer, spreads weak polynomial hash bits; updates lvalue `h`,
+ * SM_POW2 positions and shard selection use it
+ */
+#if ULONG_MAX > 0xffffffffUL
+#define SM_MIX(h) \
+    ((h) ^= (h) >> 33, (h) *= 0xff51afd7ed558ccdUL, (h) ^= (h) >> 33, \
+     (h) *= 0xc4ceb9fe1a85ec53UL, (h) ^= (h) >> 33)
+#else
+#define SM_MIX(h) \
+    ((h) ^= (h) >> 16, (h) *= 0x85ebca6bUL, (h) ^= (h) >> 13, \
+     (h) *= 0xc2b2ae35UL, (h) ^= (h) >> 16)
+#endif
+
+/* max load of linear and SM_POW2 tables, size growth of a full map */
+#define SM_LOAD_FACTOR 0.7
+#define SM_GROW_FACTOR 1.5
+
+/* data written by different threads sits on separate cache lines */
+#define SM_CACHE_LINE 64
+
+/* bytes of whole cache lines holding `size` bytes */
+#define SM_CACHE_LINES(size) \
+    (((size) + SM_CACHE_LINE - 1) / SM_CACHE_LINE * SM_CACHE_LINE)
+
+/* first cache line boundary in `block` allocated SM_CACHE_LINE bytes
+   larger than needed */
+#define SM_CACHE_ALIGN(block) \
+    ((void *)((char *)(block) \
+              + (SM_CACHE_LINE - (size_t)(block) % SM_CACHE_LINE) \
+              % SM_CACHE_LINE))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  @brief Allocate with `alloc`, malloc if NULL
+*/
+    void *sm_allocate(const SM_ALLOCATOR * alloc, size_t size);
+
+/**
+  @brief Free `ptr` (may be NULL) allocated by sm_allocate with `alloc`
+*/
+    void sm_release(const SM_ALLOCATOR * alloc, void *ptr);
+
+/**
+  @brief Capacity and max size of a `flags` layout table for at least
+  `size` keys
+  @return 1 on success, 0 on overflow
+*/
+    int sm_dimension(unsigned int flags, size_t size, size_t * msize,
+                     size_t * capacity);
+
+/**
+  @brief sm_*_n with `hash` = opts->hash(key, len) from the caller, who
+  used it already, e.g. SM_SHARDED shard selection
+*/
+    SM_RESULT sm_lookup_hashed(const STRMAP * sm, const char *key,
+                               size_t len, size_t hash, SM_ENTRY * item);
+    SM_RESULT sm_insert_hashed(STRMAP * sm, const char *key, size_t len,
+                               size_t hash, const void *data,
+                               SM_ENTRY * item);
+    SM_RESULT sm_update_hashed(STRMAP * sm, const char *key, size_t len,
+                               size_t hash, const void *data,
+                               SM_ENTRY * item);
+    SM_RESULT sm_upsert_hashed(STRMAP * sm, const char *key, size_t len,
+                               size_t hash, const void *data,
+                               SM_ENTRY * item);
+    SM_RESULT sm_remove_hashed(STRMAP * sm, const char *key, size_t len,
+                               size_t hash, SM_ENTRY * item);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,114 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file strset.c
+  @brief STRSET - string set on top of STRMAP, slots without user data
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#include <string.h>
+
+#include "strset.h"
+
+STRSET *
+ss_create(size_t size)
+{
+    return ss_create_ex(size, 0);
+}
+
+STRSET *
+ss_create_ex(size_t size, const SM_OPTIONS * opts)
+{
+    SM_OPTIONS opt;
+
+    if (opts) {
+        opt = *opts;
+    }
+    else {
+        memset(&opt, 0, sizeof opt);
+    }
+    opt.flags |= SM_KEYS_ONLY;
+
+    return sm_create_ex(size, &opt);
+}
+
+SM_RESULT
+ss_add(STRSET * ss, const char *key)
+{
+    return sm_insert_n(ss, key, strlen(key), 0, 0);
+}
+
+SM_RESULT
+ss_add_n(STRSET * ss, const char *key, size_t len)
+{
+    return sm_insert_n(ss, key, len, 0, 0);
+}
+
+int
+ss_contains(const STRSET * ss, const char *key)
+{
+    return sm_lookup_n(ss, key, strlen(key), 0) == SM_FOUND;
+}
+
+int
+ss_contains_n(const STRSET * ss, const char *key, size_t len)
+{
+    return sm_lookup_n(ss, key, len, 0) == SM_FOUND;
+}
+
+SM_RESULT
+ss_remove(STRSET * ss, const char *key)
+{
+    return sm_remove_n(ss, key, strlen(key), 0);
+}
+
+SM_RESULT
+ss_remove_n(STRSET * ss, const char *key, size_t len)
+{
+    return sm_remove_n(ss, key, len, 0);
+}
+
+size_t
+ss_size(const STRSET * ss)
+{
+    return sm_size(ss);
+}
+
+void
+ss_clear(STRSET * ss)
+{
+    sm_clear(ss);
+}
+
+void
+ss_free(STRSET * ss)
+{
+    sm_free(ss);
+}
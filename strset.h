@@ -0,0 +1,88 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * 
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ * 
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * For more information, please refer to <https://unlicense.org> 
+ */
+
+/**
+  @file strset.h
+  @brief STRSET - string set on top of STRMAP, slots without user data
+  @author I. Kakoulidis
+  @date 2021
+  @license The Unlicense
+*/
+
+#ifndef _STRSET_H
+#define _STRSET_H
+
+#include "strmap.h"
+
+/* set is a map created with SM_KEYS_ONLY, sm_foreach, sm_size,
+   sm_memory_usage and friends apply to it */
+typedef struct STRMAP STRSET;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+  @brief Create a string set which can contain at least `size` keys
+*/
+    STRSET *ss_create(size_t size);
+
+/**
+  @brief Create a string set with given options, `opts` may be NULL;
+  SM_KEYS_ONLY is implied
+  @return set or NULL with errno set to ENOMEM or EINVAL
+*/
+    STRSET *ss_create_ex(size_t size, const SM_OPTIONS * opts);
+
+/**
+  @brief Add key to the set
+  @return SM_INSERTED on success, SM_DUPLICATE or SM_MAP_FULL otherwise
+*/
+    SM_RESULT ss_add(STRSET * ss, const char *key);
+    SM_RESULT ss_add_n(STRSET * ss, const char *key, size_t len);
+
+/**
+  @brief Non zero if key is in the set
+*/
+    int ss_contains(const STRSET * ss, const char *key);
+    int ss_contains_n(const STRSET * ss, const char *key, size_t len);
+
+/**
+  @brief Remove key from the set
+  @return SM_REMOVED on success, SM_NOT_FOUND otherwise
+*/
+    SM_RESULT ss_remove(STRSET * ss, const char *key);
+    SM_RESULT ss_remove_n(STRSET * ss, const char *key, size_t len);
+
+    size_t ss_size(const STRSET * ss);
+    void ss_clear(STRSET * ss);
+    void ss_free(STRSET * ss);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
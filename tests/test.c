@@ -1,8 +1,16 @@
+#define _POSIX_C_SOURCE 200112L /* pthread under -ansi */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "greatest.h"
 #include "strmap.h"
+#include "strset.h"
+#include "shardmap.h"
+#include "rcumap.h"
+#include "lfmap.h"
 
 void fisher_yates_shuffle(char *s) {
   size_t i, j, n = strlen(s);
@@ -23,6 +31,25 @@ void check_hash(SM_ENTRY item, void *ctx) {
   }
 }
 
+/* sm_foreach callback, counts entries */
+void count_keys(SM_ENTRY item, void *ctx) {
+  if (item.key) {
+    ++*(unsigned long *)ctx;
+  }
+}
+
+/* byte at a time reference for poly_hashs */
+size_t poly_hash_ref(const char *key) {
+  size_t hash = 0;
+
+  while (*key) {
+    hash += (hash << 8) + (unsigned char) (*key);
+    ++key;
+  }
+
+  return hash;
+}
+
 char *str_dup(const char *src) {
     size_t len = strlen(src) + 1;
     
@@ -35,6 +62,72 @@ char *str_dup(const char *src) {
     return dst;
 }
 
+/* SM_ALLOCATOR counting live blocks and bytes, fails calls past limit
+   if set; block size is kept in a header */
+typedef struct MEM_STATS {
+  unsigned long blocks;
+  unsigned long calls;
+  unsigned long limit;
+  size_t bytes;
+} MEM_STATS;
+
+#define MEM_HEADER 16
+
+void *mem_alloc(void *ctx, size_t size) {
+  MEM_STATS *stats = ctx;
+  char *ptr;
+
+  if (stats->limit && stats->calls >= stats->limit) {
+    return 0;
+  }
+  ++stats->calls;
+  if (!(ptr = malloc(size + MEM_HEADER))) {
+    return 0;
+  }
+  ++stats->blocks;
+  stats->bytes += size;
+  memcpy(ptr, &size, sizeof size);
+  return ptr + MEM_HEADER;
+}
+
+void *mem_zalloc(void *ctx, size_t size) {
+  void *ptr = mem_alloc(ctx, size);
+
+  if (ptr) {
+    memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+void *mem_realloc(void *ctx, void *ptr, size_t size) {
+  MEM_STATS *stats = ctx;
+  char *base = (char *)ptr - MEM_HEADER;
+  size_t old;
+
+  if (stats->limit && stats->calls >= stats->limit) {
+    return 0;
+  }
+  ++stats->calls;
+  memcpy(&old, base, sizeof old);
+  if (!(base = realloc(base, size + MEM_HEADER))) {
+    return 0;
+  }
+  stats->bytes += size - old;
+  memcpy(base, &size, sizeof size);
+  return base + MEM_HEADER;
+}
+
+void mem_free(void *ctx, void *ptr) {
+  MEM_STATS *stats = ctx;
+  char *base = (char *)ptr - MEM_HEADER;
+  size_t size;
+
+  memcpy(&size, base, sizeof size);
+  --stats->blocks;
+  stats->bytes -= size;
+  free(base);
+}
+
 unsigned long MAP_SIZE = 1024;
 
 /* keys to insert */
@@ -122,6 +215,1635 @@ REMOVE_1() {
   PASS();
 }    
 
+/* whole API under given options */
+TEST
+MODE_1(SM_OPTIONS *opts) {
+  STRMAP *ht, *nht;
+  SM_ENTRY item;
+  unsigned long i, n;
+  int val = 1551, uval = 7117;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+    ASSERT(*(int *)item.data == val);
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+    ASSERT(sm_update(ht, xkeys[i], &uval, 0) == SM_NOT_FOUND);
+  }
+
+  nht = sm_create_from(ht, 2 * MAP_SIZE);
+  if (!nht) {
+      FAIL();
+  }
+  sm_free(ht);
+  ht = nht;
+
+  n = 0;
+  sm_foreach(ht, count_keys, &n);
+  ASSERT(n == MAP_SIZE);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    if (i % 2) {
+      ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+    } else {
+      ASSERT(sm_update(ht, keys[i], &uval, 0) == SM_UPDATED);
+    }
+  }
+  ASSERT(sm_size(ht) == (MAP_SIZE + 1) / 2);
+  for (i = 0; i < MAP_SIZE; i++) {
+    if (i % 2) {
+      ASSERT(sm_lookup(ht, keys[i], 0) == SM_NOT_FOUND);
+      ASSERT(sm_upsert(ht, keys[i], &val, 0) == SM_INSERTED);
+    }
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+    ASSERT(*(int *)item.data == (i % 2 ? val : uval));
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_upsert(ht, keys[i], &uval, 0) == SM_UPDATED);
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+    ASSERT(*(int *)item.data == uval);
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+
+  sm_clear(ht);
+  ASSERT(sm_size(ht) == 0);
+  ASSERT(sm_lookup(ht, keys[0], 0) == SM_NOT_FOUND);
+
+  sm_free(ht);
+  PASS();
+}
+
+/* short keys from one reused buffer, copied by SM_INLINE_KEYS map */
+TEST
+SHORT_1(SM_OPTIONS *opts) {
+  STRMAP *ht;
+  SM_ENTRY item, first;
+  unsigned long i, n;
+  char buf[32];
+  int val = 1551;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    sprintf(buf, "%lx", i * 2654435761UL);
+    ASSERT(sm_insert(ht, buf, &val, &item) == SM_INSERTED);
+    ASSERT(!strcmp(item.key, buf));
+    ASSERT(item.key != buf);
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+  sm_foreach(ht, check_hash, 0);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    sprintf(buf, "%lx", i * 2654435761UL);
+    ASSERT(sm_lookup(ht, buf, &item) == SM_FOUND);
+    ASSERT(!strcmp(item.key, buf));
+    ASSERT(*(int *)item.data == val);
+    sprintf(buf, "%lxz", i * 2654435761UL);
+    ASSERT(sm_lookup(ht, buf, 0) == SM_NOT_FOUND);
+  }
+
+  /* short key points into its slot, same address and bytes until the
+     map is modified */
+  if (MAP_SIZE) {
+    ASSERT(sm_lookup(ht, "0", &first) == SM_FOUND);
+    for (i = 0; i < MAP_SIZE; i++) {
+      sprintf(buf, "%lx", i * 2654435761UL);
+      ASSERT(sm_lookup(ht, buf, &item) == SM_FOUND);
+    }
+    sm_foreach(ht, check_hash, 0);
+    ASSERT(sm_lookup(ht, "0", &item) == SM_FOUND && item.key == first.key);
+    ASSERT(!strcmp(first.key, "0") && first.len == 1);
+  }
+
+  for (i = 0; i < MAP_SIZE; i += 2) {
+    sprintf(buf, "%lx", i * 2654435761UL);
+    ASSERT(sm_remove(ht, buf, &item) == SM_REMOVED);
+    ASSERT(!strcmp(item.key, buf));
+    ASSERT(sm_lookup(ht, buf, 0) == SM_NOT_FOUND);
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE / 2);
+
+  n = 0;
+  sm_foreach(ht, count_keys, &n);
+  ASSERT(n == MAP_SIZE / 2);
+
+  sm_free(ht);
+  PASS();
+}
+
+/* (pointer, length) slices of keys, not null terminated */
+TEST
+SLICE_1(SM_OPTIONS *opts) {
+  STRMAP *ht;
+  SM_ENTRY item;
+  unsigned long i;
+  size_t len;
+  int val = 1551, uval = 7117;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    len = strlen(keys[i]);
+    ASSERT(poly_hashn(keys[i], len) == poly_hashs(keys[i]));
+    ASSERT(sm_insert_n(ht, keys[i], len - 1, &val, &item) == SM_INSERTED);
+    ASSERT(item.len == len - 1);
+    ASSERT(sm_insert_n(ht, keys[i] + 5, 10, &val, 0) == SM_INSERTED);
+    ASSERT(sm_insert_n(ht, keys[i], len - 1, &val, 0) == SM_DUPLICATE);
+  }
+  ASSERT(sm_size(ht) == 2 * MAP_SIZE);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    len = strlen(keys[i]);
+    ASSERT(sm_lookup_n(ht, keys[i], len - 1, &item) == SM_FOUND);
+    ASSERT(item.len == len - 1 && !memcmp(item.key, keys[i], item.len));
+    ASSERT(sm_lookup_n(ht, keys[i] + 5, 10, &item) == SM_FOUND);
+    ASSERT(item.len == 10 && !memcmp(item.key, keys[i] + 5, 10));
+    ASSERT(sm_lookup(ht, keys[i], 0) == SM_NOT_FOUND);
+    ASSERT(sm_lookup_n(ht, keys[i], len - 2, 0) == SM_NOT_FOUND);
+    ASSERT(sm_update_n(ht, keys[i] + 5, 10, &uval, 0) == SM_UPDATED);
+    ASSERT(sm_upsert_n(ht, keys[i], len, &uval, 0) == SM_INSERTED);
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+    ASSERT(*(int *)item.data == uval);
+  }
+  ASSERT(sm_size(ht) == 3 * MAP_SIZE);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    len = strlen(keys[i]);
+    ASSERT(sm_remove_n(ht, keys[i], len - 1, 0) == SM_REMOVED);
+    ASSERT(sm_remove_n(ht, keys[i], len - 1, 0) == SM_NOT_FOUND);
+    ASSERT(sm_lookup_n(ht, keys[i] + 5, 10, &item) == SM_FOUND);
+    ASSERT(*(int *)item.data == uval);
+    ASSERT(sm_lookup_n(ht, keys[i], len, 0) == SM_FOUND);
+  }
+  ASSERT(sm_size(ht) == 2 * MAP_SIZE);
+
+  sm_free(ht);
+  PASS();
+}
+
+/* SM_INCREMENTAL: keys stay reachable while tables migrate */
+TEST
+INCREMENTAL_1(SM_OPTIONS *opts) {
+  STRMAP *ht, *nht;
+  SM_ENTRY item;
+  unsigned long i, n, removed = 0, copied = 0;
+  int val = 1551, uval = 7117, migrating = 0;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+    /* keys 1, 5, 9, ... are removed */
+    if (i % 4 == 3) {
+      ASSERT(sm_remove(ht, keys[i - 2], 0) == SM_REMOVED);
+      ++removed;
+    }
+    ASSERT(sm_size(ht) == i + 1 - removed);
+    ASSERT(sm_lookup(ht, keys[i / 2 / 4 * 4], 0) == SM_FOUND);
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+    if (sm_migrating(ht)) {
+      migrating = 1;
+      ASSERT(sm_update(ht, keys[i / 4 * 4], &val, 0) == SM_UPDATED);
+      if (!copied) {
+        nht = sm_create_from(ht, 0);
+        ASSERT(nht && !sm_migrating(nht));
+        ASSERT(sm_size(nht) == sm_size(ht));
+        sm_free(nht);
+        copied = 1;
+      }
+    }
+  }
+  ASSERT(migrating || MAP_SIZE < 100);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    if (i % 4 == 1 && i + 2 < MAP_SIZE) {
+      ASSERT(sm_lookup(ht, keys[i], 0) == SM_NOT_FOUND);
+    } else {
+      ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+      ASSERT(*(int *)item.data == val);
+    }
+  }
+  n = 0;
+  sm_foreach(ht, count_keys, &n);
+  ASSERT(n == sm_size(ht));
+
+  for (i = 0; sm_migrating(ht) && i < MAP_SIZE; i++) {
+    ASSERT(sm_upsert(ht, keys[0], &uval, 0) == SM_UPDATED);
+  }
+  ASSERT(!sm_migrating(ht));
+  for (i = 0; i < MAP_SIZE; i += 4) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == SM_FOUND);
+  }
+
+  sm_clear(ht);
+  ASSERT(sm_size(ht) == 0 && !sm_migrating(ht));
+  sm_free(ht);
+  PASS();
+}
+
+/* sm_reserve, low water mark shrink and sm_shrink_to_fit */
+TEST
+SHRINK_1(SM_OPTIONS *opts) {
+  STRMAP *ht;
+  SM_OPTIONS shrink = *opts;
+  unsigned long i, keep = MAP_SIZE / 100 + 1;
+  double capacity;
+  int val = 1551;
+
+  shrink.shrink = 25;
+  ht = sm_create_ex(0, &shrink);
+  if (!ht) {
+      FAIL();
+  }
+
+  /* no growth after reserve */
+  ASSERT(sm_reserve(ht, MAP_SIZE) == 0);
+  ASSERT(sm_insert(ht, keys[0], &val, 0) == SM_INSERTED);
+  capacity = 1.0 / sm_load_factor(ht);
+  for (i = 1; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+  }
+  ASSERT((unsigned long)(sm_load_factor(ht) * capacity + 0.5) == MAP_SIZE);
+
+  /* auto shrink keeps load above low water mark */
+  for (i = keep; i < MAP_SIZE; i++) {
+    ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+  }
+  ASSERT(sm_size(ht) == keep);
+  ASSERT(keep < 10 || sm_load_factor(ht) > 0.7 * 0.25 / 2);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == (i < keep ? SM_FOUND : SM_NOT_FOUND));
+  }
+
+  sm_clear(ht);
+  ASSERT(sm_size(ht) == 0);
+  ASSERT(sm_insert(ht, keys[0], &val, 0) == SM_INSERTED);
+  sm_free(ht);
+
+  /* explicit shrink, also during SM_INCREMENTAL migration */
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+  }
+  for (i = keep; i < MAP_SIZE; i++) {
+    ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+  }
+  ASSERT(sm_shrink_to_fit(ht) == 0);
+  ASSERT(!sm_migrating(ht));
+  ASSERT(sm_size(ht) == keep);
+  ASSERT(keep < 10 || sm_load_factor(ht) > 0.3);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == (i < keep ? SM_FOUND : SM_NOT_FOUND));
+  }
+  ASSERT(sm_upsert(ht, keys[MAP_SIZE - 1], &val, 0) == SM_INSERTED);
+  ASSERT(sm_reserve(ht, 0) == 0);
+
+  sm_free(ht);
+  PASS();
+}
+
+/* SM_OWN_KEYS: keys inserted from one reused buffer */
+TEST
+OWN_1(SM_OPTIONS *opts) {
+  STRMAP *ht, *nht;
+  SM_ENTRY item;
+  unsigned long i, n;
+  char buf[128];
+  const char *copy = 0;
+  int val = 1551;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    strcpy(buf, i % 2 ? keys[i] : keys[i] + 50);
+    ASSERT(sm_insert(ht, buf, &val, &item) == SM_INSERTED);
+    ASSERT(item.key != buf && !strcmp(item.key, buf));
+    if (i == 1) {
+      copy = item.key;
+    }
+    if (i % 3 == 0) {
+      strcpy(buf, xkeys[i]);
+      ASSERT(sm_upsert(ht, buf, &val, 0) == SM_INSERTED);
+    }
+  }
+  memset(buf, 0, sizeof buf);
+
+  /* growth and reserve move the arena, copies keep their address */
+  ASSERT(sm_reserve(ht, 4 * MAP_SIZE) == 0);
+  if (copy) {
+    ASSERT(sm_lookup(ht, keys[1], &item) == SM_FOUND && item.key == copy);
+  }
+
+  nht = sm_create_from(ht, 0);
+  if (!nht) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i += 2) {
+    ASSERT(sm_remove(ht, keys[i] + 50, &item) == SM_REMOVED);
+    ASSERT(item.key == keys[i] + 50);
+  }
+  sm_clear(ht);
+  sm_free(ht);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(nht, i % 2 ? keys[i] : keys[i] + 50, &item) == SM_FOUND);
+    ASSERT(!strcmp(item.key, i % 2 ? keys[i] : keys[i] + 50));
+    ASSERT(item.key != keys[i] && item.key != keys[i] + 50);
+    ASSERT(sm_lookup(nht, xkeys[i], 0) == (i % 3 ? SM_NOT_FOUND : SM_FOUND));
+  }
+  n = 0;
+  sm_foreach(nht, count_keys, &n);
+  ASSERT(n == sm_size(nht));
+
+  sm_free(nht);
+  PASS();
+}
+
+/* all blocks come from and return to the map allocator */
+TEST
+ALLOC_1(SM_OPTIONS *opts) {
+  MEM_STATS stats = { 0, 0, 0, 0 };
+  SM_ALLOCATOR mem = { mem_alloc, mem_zalloc, mem_realloc, mem_free, 0 };
+  SM_OPTIONS custom = *opts;
+  STRMAP *ht, *nht;
+  SM_RESULT res;
+  unsigned long i, n;
+  int val = 1551;
+
+  mem.ctx = &stats;
+  custom.alloc = &mem;
+  ht = sm_create_ex(0, &custom);
+  if (!ht) {
+      FAIL();
+  }
+  ASSERT(stats.blocks == 2);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+  }
+  nht = sm_create_from(ht, 0);
+  if (!nht) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i += 2) {
+    ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+    ASSERT(sm_lookup(nht, keys[i], 0) == SM_FOUND);
+  }
+  sm_clear(nht);
+  sm_free(nht);
+  sm_free(ht);
+  ASSERT(stats.blocks == 0);
+
+  /* failed allocation leaves map usable */
+  stats.calls = 0;
+  stats.limit = 4;
+  ht = sm_create_ex(0, &custom);
+  if (!ht) {
+      FAIL();
+  }
+  for (i = 0, n = 0; i < MAP_SIZE; i++) {
+    res = sm_insert(ht, keys[i], &val, 0);
+    ASSERT(res == SM_INSERTED || res == SM_MAP_FULL);
+    n += (res == SM_INSERTED);
+  }
+  ASSERT(n == sm_size(ht));
+  stats.limit = stats.calls;
+  ASSERT(sm_shrink_to_fit(ht) == -1);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == (i < n ? SM_FOUND : SM_NOT_FOUND));
+  }
+  sm_free(ht);
+  ASSERT(stats.blocks == 0);
+
+  PASS();
+}
+
+/* SM_HUGE_PAGES: large mapped table, then back to a small one */
+TEST
+HUGE_1(SM_OPTIONS *opts) {
+  STRMAP *ht;
+  unsigned long i;
+  int val = 1551;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+  /* table above 2 MB */
+  ASSERT(sm_reserve(ht, 100000) == 0);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == SM_FOUND);
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+  }
+  ASSERT(sm_shrink_to_fit(ht) == 0);
+  for (i = 0; i < MAP_SIZE; i += 2) {
+    ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+  }
+  ASSERT(sm_reserve(ht, 200000) == 0);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == (i % 2 ? SM_FOUND : SM_NOT_FOUND));
+  }
+  sm_clear(ht);
+  ASSERT(sm_size(ht) == 0);
+  sm_free(ht);
+
+  PASS();
+}
+
+/* SM_COMPACT: keys in regular and own arena chunks, flag checks */
+TEST
+COMPACT_1(SM_OPTIONS *opts) {
+  SM_OPTIONS bad = *opts;
+  STRMAP *ht;
+  SM_ENTRY item;
+  unsigned long i;
+  size_t len;
+  char *buf;
+  int val = 1551;
+
+  bad.flags &= ~(unsigned int)SM_OWN_KEYS;
+  ASSERT(sm_create_ex(0, &bad) == 0);
+  bad.flags |= SM_OWN_KEYS | SM_SWISS;
+  ASSERT(sm_create_ex(0, &bad) == 0);
+
+  ht = sm_create_ex(0, opts);
+  buf = malloc(40000);
+  if (!ht || !buf) {
+      FAIL();
+  }
+  /* every 16th key is longer than a quarter of arena chunk */
+  for (i = 0; i < MAP_SIZE; i++) {
+    len = (i % 16 ? i % 100 : 20000 + i % 1000);
+    memset(buf, (int)('a' + i % 26), len);
+    sprintf(buf + len, "%lu", i);
+    len += strlen(buf + len);
+    ASSERT(sm_insert_n(ht, buf, len, &val, &item) == SM_INSERTED);
+    ASSERT(item.len == len && !memcmp(item.key, buf, len));
+    ASSERT(item.hash == (unsigned int)(opts->hash ? opts->hash : poly_hashn)(buf, len));
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    len = (i % 16 ? i % 100 : 20000 + i % 1000);
+    memset(buf, (int)('a' + i % 26), len);
+    sprintf(buf + len, "%lu", i);
+    len += strlen(buf + len);
+    ASSERT(sm_lookup_n(ht, buf, len, &item) == SM_FOUND);
+    ASSERT(item.len == len && !memcmp(item.key, buf, len) && item.data == &val);
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+  }
+
+  free(buf);
+  sm_free(ht);
+  PASS();
+}
+
+/* map reused after sm_clear, few and many keys per round */
+TEST
+CLEAR_1(SM_OPTIONS *opts) {
+  STRMAP *ht;
+  unsigned long i, n, round;
+  int val = 1551;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (round = 0; round < 8; round++) {
+    n = (round % 4 == 1 ? MAP_SIZE : round + 1);
+    n = (n > MAP_SIZE ? MAP_SIZE : n);
+    for (i = 0; i < n; i++) {
+      ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+      if (i % 3 == 0) {
+        ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+        ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+      }
+    }
+    ASSERT(sm_size(ht) == n);
+    for (i = 0; i < MAP_SIZE; i++) {
+      ASSERT(sm_lookup(ht, keys[i], 0) == (i < n ? SM_FOUND : SM_NOT_FOUND));
+    }
+    sm_clear(ht);
+    ASSERT(sm_size(ht) == 0);
+    for (i = 0; i < MAP_SIZE; i++) {
+      ASSERT(sm_lookup(ht, keys[i], 0) == SM_NOT_FOUND);
+    }
+    n = 0;
+    sm_foreach(ht, count_keys, &n);
+    ASSERT(n == 0);
+  }
+
+  sm_free(ht);
+  PASS();
+}
+
+/* SM_INPLACE_GROW: keys found after growth and reserve */
+TEST
+GROW_1(SM_OPTIONS *opts) {
+  SM_OPTIONS bad = *opts;
+  STRMAP *ht, *nht;
+  SM_ENTRY item;
+  unsigned long i;
+  int val = 1551;
+
+  bad.flags |= SM_ROBIN_HOOD;
+  ASSERT(sm_create_ex(0, &bad) == 0);
+  bad.flags ^= SM_ROBIN_HOOD | SM_INCREMENTAL;
+  ASSERT(sm_create_ex(0, &bad) == 0);
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+    if (i % 5 == 0) {
+      ASSERT(sm_remove(ht, keys[i / 2], 0) == SM_REMOVED);
+      ASSERT(sm_insert(ht, keys[i / 2], &val, 0) == SM_INSERTED);
+    }
+  }
+  nht = sm_create_from(ht, 0);
+  if (!nht) {
+      FAIL();
+  }
+  ASSERT(sm_reserve(ht, 3 * MAP_SIZE) == 0);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(nht, keys[i], 0) == SM_FOUND);
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+    ASSERT(!strcmp(item.key, keys[i]) && item.data == &val);
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+
+  sm_free(nht);
+  sm_free(ht);
+  PASS();
+}
+
+/* sm_memory_usage equals bytes taken from the allocator */
+TEST
+MEMORY_1(SM_OPTIONS *opts) {
+  MEM_STATS stats = { 0, 0, 0, 0 };
+  SM_ALLOCATOR mem = { mem_alloc, mem_zalloc, mem_realloc, mem_free, 0 };
+  SM_OPTIONS custom = *opts;
+  SM_MEMORY usage;
+  STRMAP *ht;
+  unsigned long i;
+  int val = 1551;
+
+  mem.ctx = &stats;
+  custom.alloc = &mem;
+  ht = sm_create_ex(0, &custom);
+  if (!ht) {
+      FAIL();
+  }
+  ASSERT(sm_memory_usage(ht, &usage) == stats.bytes);
+  ASSERT(usage.per_key == 0.0);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], &val, 0) == SM_INSERTED);
+    if (i % 97 == 0) {
+      ASSERT(sm_memory_usage(ht, 0) == stats.bytes);
+    }
+  }
+  ASSERT(sm_memory_usage(ht, &usage) == stats.bytes);
+  ASSERT(usage.total == usage.table + usage.map + usage.keys);
+  ASSERT(usage.per_key == (double)usage.total / (double)MAP_SIZE);
+  ASSERT((usage.keys != 0) == ((opts->flags & SM_OWN_KEYS) != 0));
+  for (i = 0; i < MAP_SIZE; i += 2) {
+    ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+  }
+  ASSERT(sm_memory_usage(ht, 0) == stats.bytes);
+  sm_clear(ht);
+  ASSERT(sm_memory_usage(ht, 0) == stats.bytes);
+
+  sm_free(ht);
+  ASSERT(stats.bytes == 0);
+  PASS();
+}
+
+/* value_size: values copied into the map, kept through growth,
+   removal shifts and copies */
+typedef struct VALUE {
+  unsigned long index;
+  unsigned long count;
+  char tag[7];
+} VALUE;
+
+TEST
+VALUE_1(SM_OPTIONS *opts) {
+  SM_OPTIONS custom = *opts;
+  STRMAP *ht, *nht;
+  SM_ENTRY item;
+  SM_RESULT res;
+  VALUE val, *v;
+  unsigned long i;
+
+  custom.value_size = sizeof (VALUE);
+  ht = sm_create_ex(0, &custom);
+  if (!ht) {
+      FAIL();
+  }
+
+  memset(&val, 0, sizeof val);
+  for (i = 0; i < MAP_SIZE; i++) {
+    val.index = i;
+    ASSERT(sm_insert(ht, keys[i], &val, &item) == SM_INSERTED);
+    ASSERT(item.data != &val && ((VALUE *)item.data)->index == i);
+    if (i % 3 == 0) {
+      v = sm_emplace(ht, keys[i], &res);
+      ASSERT(v && res == SM_FOUND && v->index == i);
+      v->count += 2;
+    }
+    v = sm_emplace(ht, xkeys[i], &res);
+    ASSERT(v && res == SM_INSERTED && v->index == 0 && v->count == 0);
+    v->index = i;
+    v->count = 1;
+    if (i % 4 == 0) {
+      ASSERT(sm_remove(ht, xkeys[i / 2], &item) == SM_REMOVED);
+      ASSERT(item.data == 0);
+    }
+  }
+
+  val.index = 0;
+  val.count = 5;
+  ASSERT(sm_update(ht, keys[0], &val, 0) == SM_UPDATED);
+  ASSERT(sm_upsert(ht, keys[1], 0, 0) == SM_UPDATED);
+  nht = sm_create_from(ht, 0);
+  if (!nht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    v = sm_value(ht, keys[i]);
+    ASSERT(v && v->index == (i == 1 ? 0 : i));
+    ASSERT(v->count == (i == 0 ? 5 : i == 1 ? 0 : i % 3 == 0 ? 2 : 0));
+    ASSERT(!memcmp(v, sm_value(nht, keys[i]), sizeof *v));
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND && item.data == v);
+    v = sm_value_n(ht, xkeys[i], strlen(xkeys[i]));
+    if (i % 2 == 0 && 2 * i < MAP_SIZE) {
+      ASSERT(v == 0);
+    }
+    else {
+      ASSERT(v && v->index == i && v->count == 1);
+    }
+  }
+
+  sm_clear(ht);
+  ASSERT(sm_value(ht, keys[0]) == 0);
+  v = sm_emplace(ht, keys[0], &res);
+  ASSERT(v && res == SM_INSERTED && v->index == 0 && v->count == 0);
+
+  sm_free(nht);
+  sm_free(ht);
+  PASS();
+}
+
+/* STRSET: membership through growth, removal shifts and clear */
+TEST
+SET_1(SM_OPTIONS *opts) {
+  SM_OPTIONS bad = { SM_KEYS_ONLY | SM_COMPACT | SM_OWN_KEYS, 0, 0, 0, 0 };
+  STRSET *ss;
+  SM_ENTRY item;
+  unsigned long i, n;
+
+  ASSERT(sm_create_ex(0, &bad) == 0);
+  bad.flags = SM_SWISS;
+  ASSERT(ss_create_ex(0, &bad) == 0);
+  bad.flags = SM_DEFAULT;
+  bad.value_size = sizeof (int);
+  ASSERT(ss_create_ex(0, &bad) == 0);
+
+  ss = (opts ? ss_create_ex(0, opts) : ss_create(0));
+  if (!ss) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(ss_add(ss, keys[i]) == SM_INSERTED);
+    ASSERT(ss_add(ss, keys[i]) == SM_DUPLICATE);
+    if (i % 3 == 0) {
+      ASSERT(ss_add_n(ss, xkeys[i], strlen(xkeys[i]) - 1 - i % 8) == SM_INSERTED);
+      ASSERT(ss_remove(ss, keys[i / 2]) == SM_REMOVED);
+    }
+  }
+  for (i = 0; i < MAP_SIZE; i += 3) {
+    ASSERT(ss_add(ss, keys[i / 2]) == SM_INSERTED);
+    ASSERT(ss_contains_n(ss, xkeys[i], strlen(xkeys[i]) - 1 - i % 8));
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(ss_contains(ss, keys[i]));
+    ASSERT(!ss_contains(ss, xkeys[i]));
+    ASSERT(sm_lookup(ss, keys[i], &item) == SM_FOUND);
+    ASSERT(!strcmp(item.key, keys[i]) && item.data == 0);
+    ASSERT(item.hash == (poly_hashs(keys[i]) & 0xffffffffUL));
+  }
+  ASSERT(ss_size(ss) == MAP_SIZE + (MAP_SIZE + 2) / 3);
+  n = 0;
+  sm_foreach(ss, count_keys, &n);
+  ASSERT(n == ss_size(ss));
+
+  for (i = 0; i < MAP_SIZE; i += 2) {
+    ASSERT(ss_remove_n(ss, keys[i], strlen(keys[i])) == SM_REMOVED);
+    ASSERT(ss_remove(ss, keys[i]) == SM_NOT_FOUND);
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(ss_contains(ss, keys[i]) == (i % 2 != 0));
+  }
+  ss_clear(ss);
+  ASSERT(ss_size(ss) == 0);
+  ASSERT(!ss_contains(ss, keys[1]));
+  ASSERT(ss_add(ss, keys[1]) == SM_INSERTED);
+
+  ss_free(ss);
+  PASS();
+}
+
+/* SM_SHARDED: threads insert, look up and remove disjoint key ranges */
+#define SHARD_THREADS 4
+
+typedef struct SHARD_JOB {
+  SM_SHARDED *sm;
+  unsigned long from;
+  unsigned long to;
+  unsigned long errors;
+} SHARD_JOB;
+
+void *shard_worker(void *arg) {
+  SHARD_JOB *job = arg;
+  SM_ENTRY item;
+  unsigned long i;
+
+  for (i = job->from; i < job->to; i++) {
+    job->errors += sm_sharded_insert(job->sm, keys[i], keys[i], 0) != SM_INSERTED;
+    job->errors += sm_sharded_insert(job->sm, xkeys[i], 0, 0) != SM_INSERTED;
+  }
+  for (i = job->from; i < job->to; i++) {
+    job->errors += sm_sharded_lookup(job->sm, keys[i], &item) != SM_FOUND
+        || item.data != keys[i];
+    job->errors += sm_sharded_remove(job->sm, xkeys[i], 0) != SM_REMOVED;
+    job->errors += sm_sharded_lookup(job->sm, xkeys[i], 0) != SM_NOT_FOUND;
+  }
+  return 0;
+}
+
+TEST
+SHARD_1(SM_OPTIONS *opts) {
+  pthread_t threads[SHARD_THREADS];
+  SHARD_JOB jobs[SHARD_THREADS];
+  SM_SHARDED *sm;
+  SM_ENTRY item;
+  SM_MEMORY usage;
+  SM_OPTIONS valued = { 0, 0, 0, 0, 0 };
+  STRMAP *ht;
+  unsigned long i, n;
+  int val = 1551;
+  double diff;
+
+  ASSERT(sm_sharded_create(0, 65537, opts) == 0);
+  if (opts) {
+    valued = *opts;
+  }
+  valued.value_size = sizeof (int);
+  ASSERT(sm_sharded_create(0, 6, &valued) == 0);
+  sm = sm_sharded_create(0, 6, opts);
+  if (!sm) {
+      FAIL();
+  }
+  ASSERT(sm_sharded_shards(sm) == 8);
+
+  for (i = 0; i < SHARD_THREADS; i++) {
+    jobs[i].sm = sm;
+    jobs[i].from = MAP_SIZE * i / SHARD_THREADS;
+    jobs[i].to = MAP_SIZE * (i + 1) / SHARD_THREADS;
+    jobs[i].errors = 0;
+    ASSERT(pthread_create(&threads[i], 0, shard_worker, &jobs[i]) == 0);
+  }
+  for (i = 0; i < SHARD_THREADS; i++) {
+    pthread_join(threads[i], 0);
+    ASSERT(jobs[i].errors == 0);
+  }
+
+  ASSERT(sm_sharded_size(sm) == MAP_SIZE);
+  n = 0;
+  sm_sharded_foreach(sm, count_keys, &n);
+  ASSERT(n == MAP_SIZE);
+  ASSERT(sm_sharded_reserve(sm, 4 * MAP_SIZE) == 0);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_sharded_insert(sm, keys[i], 0, 0) == SM_DUPLICATE);
+    ASSERT(sm_sharded_update(sm, keys[i], &val, 0) == SM_UPDATED);
+    ASSERT(sm_sharded_upsert_n(sm, keys[i], strlen(keys[i]), &val, 0)
+           == SM_UPDATED);
+    ASSERT(sm_sharded_lookup_n(sm, keys[i], strlen(keys[i]), &item)
+           == SM_FOUND && item.data == &val);
+  }
+  ASSERT(sm_sharded_shrink_to_fit(sm) == 0);
+  ASSERT(sm_sharded_memory_usage(sm, &usage) == usage.total);
+  ASSERT(usage.per_key == (double)usage.total / (double)MAP_SIZE);
+  ASSERT(sm_sharded_load_factor(sm) > 0.0);
+  sm_sharded_clear(sm);
+  ASSERT(sm_sharded_size(sm) == 0);
+  ASSERT(sm_sharded_lookup(sm, keys[0], 0) == SM_NOT_FOUND);
+  sm_sharded_free(sm);
+
+  /* one shard probes as the map it wraps */
+  sm = sm_sharded_create(0, 1, opts);
+  ht = sm_create_ex(0, opts);
+  if (!sm || !ht) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_sharded_insert(sm, keys[i], 0, 0) == SM_INSERTED);
+    ASSERT(sm_insert(ht, keys[i], 0, 0) == SM_INSERTED);
+  }
+  ASSERT(sm_sharded_probes_mean(sm) == sm_probes_mean(ht));
+  diff = sm_sharded_probes_var(sm) - sm_probes_var(ht);
+  ASSERT(diff < 1e-9 && diff > -1e-9);
+  sm_free(ht);
+
+  sm_sharded_free(sm);
+  PASS();
+}
+
+/* SM_RCU: readers look up keys present throughout while the writer
+   inserts, upserts and removes other keys */
+#define RCU_READERS 3
+
+typedef struct RCU_JOB {
+  SM_RCU *sm;
+  unsigned int reader;
+  unsigned long errors;
+} RCU_JOB;
+
+void rcu_size(const STRMAP *map, void *ctx) {
+  *(size_t *)ctx = sm_size(map);
+}
+
+void *rcu_reader(void *arg) {
+  RCU_JOB *job = arg;
+  SM_ENTRY item;
+  unsigned long i, pass;
+  size_t size;
+
+  for (pass = 0; pass < 4; pass++) {
+    for (i = 0; i < MAP_SIZE / 2; i++) {
+      job->errors += sm_rcu_lookup(job->sm, job->reader, keys[i], &item)
+          != SM_FOUND || item.data != keys[i];
+      sm_rcu_lookup(job->sm, job->reader, xkeys[i], 0);
+    }
+    sm_rcu_read(job->sm, job->reader, rcu_size, &size);
+    job->errors += size < MAP_SIZE / 2;
+  }
+  return 0;
+}
+
+TEST
+RCU_1(SM_OPTIONS *opts) {
+  MEM_STATS stats = { 0, 0, 0, 0 };
+  SM_ALLOCATOR mem = { mem_alloc, mem_zalloc, mem_realloc, mem_free, 0 };
+  SM_OPTIONS custom = { SM_DEFAULT, 0, 0, 0, 0 };
+  pthread_t threads[RCU_READERS];
+  RCU_JOB jobs[RCU_READERS];
+  SM_RCU *sm;
+  SM_ENTRY item;
+  SM_MEMORY usage;
+  SM_RESULT res;
+  unsigned long i, budget;
+  size_t size;
+  int val = 1551;
+
+  ASSERT(sm_rcu_create(0, 65537, opts) == 0);
+  sm = sm_rcu_create(0, RCU_READERS, opts);
+  if (!sm) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE / 2; i++) {
+    ASSERT(sm_rcu_insert(sm, keys[i], keys[i], 0) == SM_INSERTED);
+  }
+
+  for (i = 0; i < RCU_READERS; i++) {
+    jobs[i].sm = sm;
+    jobs[i].reader = (unsigned int)i;
+    jobs[i].errors = 0;
+    ASSERT(pthread_create(&threads[i], 0, rcu_reader, &jobs[i]) == 0);
+  }
+  for (i = MAP_SIZE / 2; i < MAP_SIZE; i++) {
+    ASSERT(sm_rcu_insert(sm, keys[i], keys[i], 0) == SM_INSERTED);
+    ASSERT(sm_rcu_insert_n(sm, xkeys[i], strlen(xkeys[i]), 0, 0)
+           == SM_INSERTED);
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_rcu_upsert(sm, keys[i], keys[i], 0) == SM_UPDATED);
+    if (i >= MAP_SIZE / 2) {
+      ASSERT(sm_rcu_remove(sm, xkeys[i], &item) == SM_REMOVED);
+      ASSERT(sm_rcu_remove_n(sm, xkeys[i], strlen(xkeys[i]), 0)
+             == SM_NOT_FOUND);
+    }
+  }
+  for (i = 0; i < RCU_READERS; i++) {
+    pthread_join(threads[i], 0);
+    ASSERT(jobs[i].errors == 0);
+  }
+
+  ASSERT(sm_rcu_size(sm) == MAP_SIZE);
+  ASSERT(sm_rcu_reserve(sm, 4 * MAP_SIZE) == 0);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_rcu_insert(sm, keys[i], 0, 0) == SM_DUPLICATE);
+    ASSERT(sm_rcu_update(sm, keys[i], &val, &item) == SM_UPDATED
+           && item.data == keys[i]);
+    ASSERT(sm_rcu_update_n(sm, keys[i], strlen(keys[i]), &val, 0)
+           == SM_UPDATED);
+    ASSERT(sm_rcu_lookup_n(sm, 0, keys[i], strlen(keys[i]), &item)
+           == SM_FOUND && item.data == &val);
+  }
+  ASSERT(sm_rcu_update(sm, xkeys[0], &val, 0) == SM_NOT_FOUND);
+  sm_rcu_read(sm, 1, rcu_size, &size);
+  ASSERT(size == MAP_SIZE);
+  ASSERT(sm_rcu_memory_usage(sm, &usage) == usage.total);
+  ASSERT(usage.per_key == (double)usage.total / (double)MAP_SIZE);
+  sm_rcu_clear(sm);
+  ASSERT(sm_rcu_size(sm) == 0);
+  ASSERT(sm_rcu_lookup(sm, 2, keys[0], 0) == SM_NOT_FOUND);
+  sm_rcu_free(sm);
+
+  /* growing budget of allocations: an insert the second map can not
+     take is undone */
+  if (opts) {
+    custom = *opts;
+  }
+  mem.ctx = &stats;
+  custom.alloc = &mem;
+  sm = sm_rcu_create(0, 1, &custom);
+  if (!sm) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    for (budget = 1;; budget++) {
+      stats.limit = stats.calls + budget;
+      res = sm_rcu_insert(sm, keys[i], keys[i], 0);
+      stats.limit = 0;
+      if (res == SM_INSERTED) {
+        break;
+      }
+      ASSERT(res == SM_MAP_FULL);
+      ASSERT(sm_rcu_lookup(sm, 0, keys[i], 0) == SM_NOT_FOUND);
+      ASSERT(sm_rcu_size(sm) == i);
+    }
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_rcu_remove(sm, keys[i], &item) == SM_REMOVED
+           && item.data == keys[i]);
+  }
+  ASSERT(sm_rcu_size(sm) == 0);
+  sm_rcu_free(sm);
+  ASSERT(stats.bytes == 0);
+  PASS();
+}
+
+/* SM_SEQLOCK: lookups run while one writer grows, shrinks and updates */
+#define SEQ_READERS 3
+
+typedef struct SEQ_JOB {
+  STRMAP *sm;
+  unsigned long errors;
+} SEQ_JOB;
+
+void *seq_reader(void *arg) {
+  SEQ_JOB *job = arg;
+  SM_ENTRY item;
+  unsigned long i, pass;
+
+  for (pass = 0; pass < 4; pass++) {
+    for (i = 0; i < MAP_SIZE / 2; i++) {
+      job->errors += sm_lookup(job->sm, keys[i], &item) != SM_FOUND
+          || item.data != keys[i] || strcmp(item.key, keys[i]);
+      sm_lookup(job->sm, xkeys[i], 0);
+    }
+  }
+  return 0;
+}
+
+TEST
+SEQ_1(SM_OPTIONS *opts) {
+  SM_OPTIONS bad = *opts;
+  pthread_t threads[SEQ_READERS];
+  SEQ_JOB jobs[SEQ_READERS];
+  STRMAP *sm;
+  SM_ENTRY item;
+  SM_MEMORY usage;
+  unsigned long i;
+
+  bad.flags |= SM_SWISS;
+  ASSERT(sm_create_ex(0, &bad) == 0);
+  bad.flags = opts->flags | SM_INCREMENTAL;
+  ASSERT(sm_create_ex(0, &bad) == 0);
+  bad.flags = opts->flags;
+  bad.value_size = sizeof (int);
+  ASSERT(sm_create_ex(0, &bad) == 0);
+
+  sm = sm_create_ex(0, opts);
+  if (!sm) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE / 2; i++) {
+    ASSERT(sm_insert(sm, keys[i], keys[i], 0) == SM_INSERTED);
+  }
+
+  for (i = 0; i < SEQ_READERS; i++) {
+    jobs[i].sm = sm;
+    jobs[i].errors = 0;
+    ASSERT(pthread_create(&threads[i], 0, seq_reader, &jobs[i]) == 0);
+  }
+  for (i = MAP_SIZE / 2; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(sm, keys[i], keys[i], 0) == SM_INSERTED);
+    ASSERT(sm_insert(sm, xkeys[i], 0, 0) == SM_INSERTED);
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_upsert(sm, keys[i], keys[i], 0) == SM_UPDATED);
+    ASSERT(sm_update(sm, keys[i], keys[i], 0) == SM_UPDATED);
+    if (i >= MAP_SIZE / 2) {
+      ASSERT(sm_remove(sm, xkeys[i], 0) == SM_REMOVED);
+    }
+  }
+  ASSERT(sm_reserve(sm, 4 * MAP_SIZE) == 0);
+  ASSERT(sm_shrink_to_fit(sm) == 0);
+  for (i = 0; i < SEQ_READERS; i++) {
+    pthread_join(threads[i], 0);
+    ASSERT(jobs[i].errors == 0);
+  }
+
+  ASSERT(sm_size(sm) == MAP_SIZE);
+  sm_memory_usage(sm, &usage);
+  sm_reclaim(sm);
+  ASSERT(sm_memory_usage(sm, 0) < usage.total);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(sm, keys[i], &item) == SM_FOUND
+           && item.data == keys[i]);
+    ASSERT(sm_lookup(sm, xkeys[i], 0) == SM_NOT_FOUND);
+  }
+  sm_clear(sm);
+  ASSERT(sm_size(sm) == 0);
+  ASSERT(sm_lookup(sm, keys[0], 0) == SM_NOT_FOUND);
+
+  sm_free(sm);
+  PASS();
+}
+
+/* SM_LFMAP: every thread inserts every key, starting at its own offset,
+   so each key is inserted once and found a duplicate by the others */
+#define LF_THREADS 4
+
+typedef struct LF_JOB {
+  SM_LFMAP *sm;
+  unsigned long from;
+  unsigned long inserted;
+  unsigned long errors;
+} LF_JOB;
+
+void *lf_worker(void *arg) {
+  LF_JOB *job = arg;
+  SM_ENTRY item;
+  SM_RESULT res;
+  unsigned long i, n;
+
+  for (n = 0; n < MAP_SIZE; n++) {
+    i = (job->from + n) % MAP_SIZE;
+    res = sm_lf_insert(job->sm, keys[i], keys[i], &item);
+    job->inserted += res == SM_INSERTED;
+    job->errors += (res != SM_INSERTED && res != SM_DUPLICATE)
+        || item.data != keys[i] || strcmp(item.key, keys[i]);
+    job->errors += sm_lf_lookup(job->sm, keys[i], &item) != SM_FOUND
+        || item.data != keys[i];
+    job->errors += sm_lf_lookup(job->sm, xkeys[i], 0) != SM_NOT_FOUND;
+  }
+  return 0;
+}
+
+TEST
+LF_1(SM_OPTIONS *opts) {
+  SM_OPTIONS bad = { SM_OWN_KEYS, 0, 0, 0, 0 };
+  pthread_t threads[LF_THREADS];
+  LF_JOB jobs[LF_THREADS];
+  SM_LFMAP *sm;
+  SM_ENTRY item;
+  SM_MEMORY usage;
+  unsigned long i, n;
+
+  ASSERT(sm_lf_create(0, &bad) == 0);
+  sm = sm_lf_create(0, opts);
+  if (!sm) {
+      FAIL();
+  }
+
+  for (i = 0; i < LF_THREADS; i++) {
+    jobs[i].sm = sm;
+    jobs[i].from = MAP_SIZE * i / LF_THREADS;
+    jobs[i].inserted = 0;
+    jobs[i].errors = 0;
+    ASSERT(pthread_create(&threads[i], 0, lf_worker, &jobs[i]) == 0);
+  }
+  n = 0;
+  for (i = 0; i < LF_THREADS; i++) {
+    pthread_join(threads[i], 0);
+    ASSERT(jobs[i].errors == 0);
+    n += jobs[i].inserted;
+  }
+  ASSERT(n == MAP_SIZE);
+
+  ASSERT(sm_lf_size(sm) == MAP_SIZE);
+  n = 0;
+  sm_lf_foreach(sm, count_keys, &n);
+  ASSERT(n == MAP_SIZE);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lf_insert_n(sm, keys[i], strlen(keys[i]), 0, 0)
+           == SM_DUPLICATE);
+    ASSERT(sm_lf_lookup_n(sm, keys[i], strlen(keys[i]), &item) == SM_FOUND
+           && item.data == keys[i] && item.len == strlen(keys[i]));
+  }
+  ASSERT(sm_lf_memory_usage(sm, &usage) == usage.total);
+  ASSERT(usage.per_key == (double)usage.total / (double)MAP_SIZE);
+
+  sm_lf_free(sm);
+  PASS();
+}
+
+/* sm_build: every key twice, the first copy's data is kept */
+TEST
+BUILD_1(SM_OPTIONS *opts) {
+  const char **all;
+  const void **datas;
+  STRMAP *ht;
+  SM_ENTRY item;
+  unsigned long i, n;
+
+  all = calloc(2 * MAP_SIZE, sizeof (char *));
+  datas = calloc(2 * MAP_SIZE, sizeof (void *));
+  if (!all || !datas) {
+      FAIL();
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    all[i] = all[2 * MAP_SIZE - 1 - i] = keys[i];
+    datas[i] = keys[i];
+    datas[2 * MAP_SIZE - 1 - i] = xkeys[i];
+  }
+
+  ht = sm_build_ex(all, datas, 2 * MAP_SIZE, 4, opts);
+  if (!ht) {
+      FAIL();
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+  n = 0;
+  sm_foreach(ht, count_keys, &n);
+  ASSERT(n == MAP_SIZE);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+    ASSERT(item.len == strlen(keys[i]) && !strcmp(item.key, keys[i]));
+    ASSERT(item.data == (opts && (opts->flags & SM_KEYS_ONLY) ? 0 : keys[i]));
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+    ASSERT(sm_insert(ht, keys[i], 0, 0) == SM_DUPLICATE);
+  }
+  /* the built map is an ordinary one */
+  for (i = 0; i < MAP_SIZE; i += 2) {
+    ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+    ASSERT(sm_insert(ht, xkeys[i], 0, 0) == SM_INSERTED);
+  }
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == (i % 2 ? SM_FOUND : SM_NOT_FOUND));
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == (i % 2 ? SM_NOT_FOUND : SM_FOUND));
+  }
+  sm_free(ht);
+
+  ht = sm_build(all, 0, MAP_SIZE, 1);
+  if (!ht) {
+      FAIL();
+  }
+  ASSERT(sm_size(ht) == MAP_SIZE);
+  ASSERT(sm_lookup(ht, keys[0], &item) == SM_FOUND && item.data == 0);
+  sm_free(ht);
+
+  ht = sm_build(all, 0, 0, 4);
+  ASSERT(ht && sm_size(ht) == 0);
+  sm_free(ht);
+
+  free(all);
+  free(datas);
+  PASS();
+}
+
+/* word at a time poly_hashs and poly_hashn against reference */
+TEST
+POLY_1() {
+  char buf[16 + 300 + 1];
+  char *key;
+  size_t off, len, i;
+
+  for (off = 0; off < 16; off++) {
+    for (len = 0; len <= 300; len++) {
+      for (i = 0; i < len; i++) {
+        buf[off + i] = (char)(1 + rand() % 255);
+      }
+      buf[off + len] = 0;
+      ASSERT(poly_hashs(buf + off) == poly_hash_ref(buf + off));
+      ASSERT(poly_hashn(buf + off, len) == poly_hash_ref(buf + off));
+    }
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(poly_hashs(keys[i]) == poly_hash_ref(keys[i]));
+    ASSERT(poly_hashs(xkeys[i] + i % 8) == poly_hash_ref(xkeys[i] + i % 8));
+  }
+
+  key = str_dup("");
+  ASSERT(poly_hashs(key) == 0);
+  free(key);
+
+  PASS();
+}
+
+/* stored hash follows map hash function, also in copied map */
+TEST
+HASH_1(SM_OPTIONS *opts) {
+  STRMAP *ht, *nht;
+  SM_ENTRY item;
+  unsigned long i;
+  size_t len;
+
+#if ULONG_MAX > 0xffffffffUL
+  ASSERT(sm_hash_crc32c("123456789", 9) == 0xe3069283UL * 0x9e3779b97f4a7c15UL);
+#else
+  ASSERT(sm_hash_crc32c("123456789", 9) == 0xe3069283UL);
+#endif
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], 0, 0) == SM_INSERTED);
+  }
+  nht = sm_create_from(ht, 2 * MAP_SIZE);
+  if (!nht) {
+      FAIL();
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    len = strlen(keys[i]);
+    ASSERT(sm_hash_wy(keys[i], len) == sm_hash_wy(keys[i], len));
+    ASSERT(sm_hash_wy(keys[i], len) != sm_hash_wy(keys[i], len - 1));
+    ASSERT(sm_lookup(ht, keys[i], &item) == SM_FOUND);
+    ASSERT(item.hash == opts->hash(keys[i], len));
+    ASSERT(sm_lookup(nht, keys[i], &item) == SM_FOUND);
+    ASSERT(item.hash == opts->hash(keys[i], len));
+    ASSERT(sm_lookup(nht, xkeys[i], 0) == SM_NOT_FOUND);
+  }
+
+  sm_free(ht);
+  sm_free(nht);
+  PASS();
+}
+
+/* four hash values, clusters longer than cached probe distances */
+size_t clustered_hash(const char *key, size_t len) {
+  return poly_hashn(key, len) % 4;
+}
+
+/* SM_ROBIN_HOOD order through saturated distances, displace and
+   backward shift */
+TEST
+PROBES_1(SM_OPTIONS *opts) {
+  STRMAP *ht;
+  SM_OPTIONS clustered = *opts;
+  unsigned long i, n = (MAP_SIZE < 2000 ? MAP_SIZE : 2000);
+
+  clustered.hash = clustered_hash;
+  ht = sm_create_ex(0, &clustered);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < n; i++) {
+    ASSERT(sm_insert(ht, keys[i], 0, 0) == SM_INSERTED);
+  }
+  for (i = 0; i < n; i += 2) {
+    ASSERT(sm_remove(ht, keys[i], 0) == SM_REMOVED);
+  }
+  for (i = 0; i < n; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == (i % 2 ? SM_FOUND : SM_NOT_FOUND));
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+  }
+  for (i = 0; i < n; i += 2) {
+    ASSERT(sm_insert(ht, keys[i], 0, 0) == SM_INSERTED);
+  }
+  for (i = 0; i < n; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == SM_FOUND);
+  }
+  ASSERT(sm_size(ht) == n);
+
+  sm_free(ht);
+  PASS();
+}
+
+/* sm_foreach callback, appends keys in slot order */
+void collect_keys(SM_ENTRY item, void *ctx) {
+  *(*(const char ***)ctx)++ = item.key;
+}
+
+/* one hash value for every key, a single probe sequence */
+size_t one_hash_value;
+
+size_t one_hash(const char *key, size_t len) {
+  (void)key;
+  (void)len;
+  return one_hash_value;
+}
+
+/* keys "g<n>" in generations of 32 sharing a hash value, each fills
+   whole groups its removal leaves tombstones in */
+size_t generation_hash(const char *key, size_t len) {
+  (void)len;
+  return strtoul(key + 1, 0, 10) / 32;
+}
+
+/* more keys than a 16 or 32 slot group holds, fewer than 128 slots */
+#define GROUP_KEYS 40
+
+/* SM_SWISS probe sequences across group boundaries and around the end
+   of the table, tombstone reuse, churn at constant size rehashes the
+   tombstones away without growth */
+TEST
+SWISS_1(SM_OPTIONS *opts) {
+  MEM_STATS stats = { 0, 0, 0, 0 };
+  SM_ALLOCATOR mem = { mem_alloc, mem_zalloc, mem_realloc, mem_free, 0 };
+  SM_OPTIONS one = *opts, custom = *opts;
+  SM_MEMORY m1, m2;
+  STRMAP *ht;
+  char names[GROUP_KEYS][16], missing[16], extra[] = "extra";
+  const char *a[GROUP_KEYS], *b[GROUP_KEYS], **p;
+  unsigned long i, v, calls;
+  int wrapped = 0, straight = 0;
+
+  one.hash = one_hash;
+  for (i = 0; i < GROUP_KEYS; i++) {
+    sprintf(names[i], "g%lu", i);
+  }
+
+  /* groups in insertion order unless the sequence wraps to group 0 */
+  for (v = 0; v < 256 && !(wrapped && straight); v++) {
+    one_hash_value = v;
+    ht = sm_create_ex(100, &one);
+    if (!ht) {
+        FAIL();
+    }
+    for (i = 0; i < GROUP_KEYS; i++) {
+      ASSERT(sm_insert(ht, names[i], 0, 0) == SM_INSERTED);
+    }
+    ASSERT(sm_probes_mean(ht) > 0.0);
+    p = a;
+    sm_foreach(ht, collect_keys, &p);
+    ASSERT(p == a + GROUP_KEYS);
+    for (i = 0; i < GROUP_KEYS && a[i] == names[i]; i++) {
+    }
+    if (i < GROUP_KEYS) {
+      wrapped = 1;
+    }
+    else {
+      straight = 1;
+    }
+    for (i = 0; i < GROUP_KEYS; i++) {
+      ASSERT(sm_lookup(ht, names[i], 0) == SM_FOUND);
+      sprintf(missing, "x%lu", i);
+      ASSERT(sm_lookup(ht, missing, 0) == SM_NOT_FOUND);
+    }
+    for (i = 0; i < GROUP_KEYS; i += 3) {
+      ASSERT(sm_remove(ht, names[i], 0) == SM_REMOVED);
+    }
+    for (i = 0; i < GROUP_KEYS; i++) {
+      ASSERT(sm_lookup(ht, names[i], 0) == (i % 3 ? SM_FOUND : SM_NOT_FOUND));
+    }
+    for (i = 0; i < GROUP_KEYS; i += 3) {
+      ASSERT(sm_insert(ht, names[i], 0, 0) == SM_INSERTED);
+    }
+    ASSERT(sm_size(ht) == GROUP_KEYS);
+    sm_free(ht);
+  }
+  ASSERT(wrapped && straight);
+
+  /* removed key of a full group leaves a tombstone, next key of the
+     sequence takes its slot */
+  ht = sm_create_ex(100, &one);
+  if (!ht) {
+      FAIL();
+  }
+  for (i = 0; i < GROUP_KEYS; i++) {
+    ASSERT(sm_insert(ht, names[i], 0, 0) == SM_INSERTED);
+  }
+  sm_memory_usage(ht, &m1);
+  p = a;
+  sm_foreach(ht, collect_keys, &p);
+  ASSERT(sm_remove(ht, names[5], 0) == SM_REMOVED);
+  ASSERT(sm_insert(ht, extra, 0, 0) == SM_INSERTED);
+  p = b;
+  sm_foreach(ht, collect_keys, &p);
+  for (i = 0; i < GROUP_KEYS; i++) {
+    ASSERT(b[i] == (a[i] == names[5] ? extra : a[i]));
+  }
+  sm_memory_usage(ht, &m2);
+  ASSERT(m1.table == m2.table);
+  sm_free(ht);
+
+  /* tombstones count toward max size, rehash at the same capacity */
+  mem.ctx = &stats;
+  custom.alloc = &mem;
+  custom.hash = generation_hash;
+  ht = sm_create_ex(100, &custom);
+  if (!ht) {
+      FAIL();
+  }
+  for (i = 0; i < GROUP_KEYS; i++) {
+    ASSERT(sm_insert(ht, names[i], 0, 0) == SM_INSERTED);
+  }
+  sm_memory_usage(ht, &m1);
+  calls = stats.calls;
+  for (v = GROUP_KEYS; v < 8 * 128; v++) {
+    i = v % GROUP_KEYS;
+    ASSERT(sm_remove(ht, names[i], 0) == SM_REMOVED);
+    sprintf(names[i], "g%lu", v);
+    ASSERT(sm_insert(ht, names[i], 0, 0) == SM_INSERTED);
+    ASSERT(sm_size(ht) == GROUP_KEYS);
+  }
+  ASSERT(stats.calls > calls);
+  sm_memory_usage(ht, &m2);
+  ASSERT(m1.table == m2.table);
+  for (v = 0; v < 8 * 128; v++) {
+    sprintf(missing, "g%lu", v);
+    ASSERT(sm_lookup(ht, missing, 0)
+           == (v >= 8 * 128 - GROUP_KEYS ? SM_FOUND : SM_NOT_FOUND));
+  }
+  sm_free(ht);
+  ASSERT(stats.blocks == 0);
+
+  PASS();
+}
+
+/* home slot of key is its first digit, hash % capacity */
+size_t digit_hash(const char *key, size_t len) {
+  (void)len;
+  return (size_t)(key[0] - '0');
+}
+
+/* homes of keys in slot order */
+int homes_are(STRMAP *ht, const char *homes) {
+  const char *order[16], **p = order;
+  size_t i;
+
+  sm_foreach(ht, collect_keys, &p);
+  for (i = 0; i < (size_t)(p - order); i++) {
+    if (order[i][0] != homes[i]) {
+      return 0;
+    }
+  }
+  return !homes[i];
+}
+
+/* SM_ROBIN_HOOD: insert stops before the first slot closer to its home
+   than the probe, as lookup of a missing key does; removal shifts the
+   rest of the cluster one slot back */
+TEST
+ROBIN_1(SM_OPTIONS *opts) {
+  static const char *const ORDER[] = {
+    "2a", "0a", "2b", "0b", "2c", "0c", "2d", "0d", "1a", "1b"
+  };
+  SM_OPTIONS homes = *opts;
+  STRMAP *ht;
+  size_t i;
+
+  homes.hash = digit_hash;
+  ht = sm_create_ex(64, &homes);
+  if (!ht) {
+      FAIL();
+  }
+
+  for (i = 0; i < 8; i++) {
+    ASSERT(sm_insert(ht, ORDER[i], 0, 0) == SM_INSERTED);
+  }
+  /* 0s at 0-3, 2s pushed to 4-7 */
+  ASSERT(homes_are(ht, "00002222"));
+  ASSERT_EQ(sm_probes_mean(ht), (0 + 1 + 2 + 3 + 2 + 3 + 4 + 5) / 8.0);
+
+  /* 1s stop at slot 4, a 2 at distance 2 is richer than a probe at 3 */
+  ASSERT(sm_insert(ht, ORDER[8], 0, 0) == SM_INSERTED);
+  ASSERT(sm_insert(ht, ORDER[9], 0, 0) == SM_INSERTED);
+  ASSERT(homes_are(ht, "0000112222"));
+  ASSERT_EQ(sm_probes_mean(ht), (6 + 3 + 4 + 4 + 5 + 6 + 7) / 10.0);
+  ASSERT(sm_lookup(ht, "1z", 0) == SM_NOT_FOUND);
+  ASSERT(sm_lookup(ht, "0z", 0) == SM_NOT_FOUND);
+  ASSERT(sm_lookup(ht, "3z", 0) == SM_NOT_FOUND);
+  for (i = 0; i < 10; i++) {
+    ASSERT(sm_lookup(ht, ORDER[i], 0) == SM_FOUND);
+  }
+
+  /* each later key one slot back, one probe closer to home */
+  ASSERT(sm_remove(ht, "0a", 0) == SM_REMOVED);
+  ASSERT(homes_are(ht, "000112222"));
+  ASSERT_EQ(sm_probes_mean(ht), (3 + 2 + 3 + 3 + 4 + 5 + 6) / 9.0);
+  ASSERT(sm_remove(ht, "1a", 0) == SM_REMOVED);
+  ASSERT(sm_remove(ht, "1b", 0) == SM_REMOVED);
+  ASSERT(homes_are(ht, "0002222"));
+  ASSERT_EQ(sm_probes_mean(ht), (3 + 1 + 2 + 3 + 4) / 7.0);
+  ASSERT(sm_remove(ht, "0b", 0) == SM_REMOVED);
+  ASSERT(sm_remove(ht, "0c", 0) == SM_REMOVED);
+  ASSERT(sm_remove(ht, "0d", 0) == SM_REMOVED);
+  ASSERT(homes_are(ht, "2222"));
+  ASSERT_EQ(sm_probes_mean(ht), (0 + 1 + 2 + 3) / 4.0);
+  for (i = 0; i < 8; i += 2) {
+    ASSERT(sm_lookup(ht, ORDER[i], 0) == SM_FOUND);
+  }
+
+  sm_free(ht);
+  PASS();
+}
+
+/* slots of the SM_ENTRY table under `flags`, from its bytes */
+size_t table_capacity(const STRMAP *ht, unsigned int flags) {
+  SM_MEMORY m;
+
+  sm_memory_usage(ht, &m);
+  return m.table / (sizeof (SM_ENTRY)
+                    + (flags & SM_SPLIT ? sizeof (unsigned int) : 0)
+                    + (flags & SM_ROBIN_HOOD ? 1 : 0));
+}
+
+/* SM_POW2 capacity is a power of two after create, each growth,
+   reserve and shrink */
+TEST
+POW2_1(SM_OPTIONS *opts) {
+  STRMAP *ht;
+  unsigned long i;
+  size_t capacity, last;
+
+  ht = sm_create_ex(0, opts);
+  if (!ht) {
+      FAIL();
+  }
+
+  last = table_capacity(ht, opts->flags);
+  ASSERT(last && !(last & (last - 1)));
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_insert(ht, keys[i], 0, 0) == SM_INSERTED);
+    capacity = table_capacity(ht, opts->flags);
+    ASSERT(!(capacity & (capacity - 1)));
+    ASSERT(capacity == last || capacity == 2 * last);
+    ASSERT(sm_load_factor(ht) <= 0.7);
+    last = capacity;
+  }
+
+  ASSERT(sm_reserve(ht, 3 * MAP_SIZE) == 0);
+  capacity = table_capacity(ht, opts->flags);
+  ASSERT(!(capacity & (capacity - 1)));
+  ASSERT(capacity * 7 >= 3 * MAP_SIZE * 10);
+  ASSERT(sm_shrink_to_fit(ht) == 0);
+  capacity = table_capacity(ht, opts->flags);
+  ASSERT(!(capacity & (capacity - 1)));
+  ASSERT(capacity <= last);
+  for (i = 0; i < MAP_SIZE; i++) {
+    ASSERT(sm_lookup(ht, keys[i], 0) == SM_FOUND);
+    ASSERT(sm_lookup(ht, xkeys[i], 0) == SM_NOT_FOUND);
+  }
+
+  sm_free(ht);
+  PASS();
+}
 
 GREATEST_MAIN_DEFS();
 int main(int argc, char **argv) {
@@ -129,6 +1851,45 @@ int main(int argc, char **argv) {
   char xstr[] = "ZbcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
   unsigned long i;  
   char *ptr;  
+  SM_OPTIONS split = { SM_SPLIT, 0, 0, 0, 0 };
+  SM_OPTIONS swiss = { SM_SWISS, 0, 0, 0, 0 };
+  SM_OPTIONS robin_hood = { SM_ROBIN_HOOD, 0, 0, 0, 0 };
+  SM_OPTIONS pow2 = { SM_POW2, 0, 0, 0, 0 };
+  SM_OPTIONS pow2_split = { SM_POW2 | SM_SPLIT, 0, 0, 0, 0 };
+  SM_OPTIONS pow2_robin_hood = { SM_POW2 | SM_ROBIN_HOOD, 0, 0, 0, 0 };
+  SM_OPTIONS inline_keys = { SM_INLINE_KEYS, 0, 0, 0, 0 };
+  SM_OPTIONS pow2_robin_hood_inline = { SM_POW2 | SM_ROBIN_HOOD | SM_INLINE_KEYS, 0, 0, 0, 0 };
+  SM_OPTIONS wy = { SM_DEFAULT, sm_hash_wy, 0, 0, 0 };
+  SM_OPTIONS crc32c = { SM_DEFAULT, sm_hash_crc32c, 0, 0, 0 };
+  SM_OPTIONS swiss_wy = { SM_SWISS, sm_hash_wy, 0, 0, 0 };
+  SM_OPTIONS pow2_crc32c = { SM_POW2 | SM_ROBIN_HOOD, sm_hash_crc32c, 0, 0, 0 };
+  SM_OPTIONS incremental = { SM_INCREMENTAL, 0, 0, 0, 0 };
+  SM_OPTIONS incremental_swiss = { SM_INCREMENTAL | SM_SWISS, 0, 0, 0, 0 };
+  SM_OPTIONS incremental_split = { SM_INCREMENTAL | SM_SPLIT | SM_POW2, 0, 0, 0, 0 };
+  SM_OPTIONS incremental_inline =
+      { SM_INCREMENTAL | SM_INLINE_KEYS | SM_ROBIN_HOOD, 0, 0, 0, 0 };
+  SM_OPTIONS own_keys = { SM_OWN_KEYS, 0, 0, 0, 0 };
+  SM_OPTIONS own_incremental = { SM_OWN_KEYS | SM_INCREMENTAL | SM_SWISS, 0, 0, 0, 0 };
+  SM_OPTIONS own_inline = { SM_OWN_KEYS | SM_INLINE_KEYS | SM_INCREMENTAL, 0, 25, 0, 0 };
+  SM_OPTIONS huge = { SM_HUGE_PAGES, 0, 0, 0, 0 };
+  SM_OPTIONS compact = { SM_COMPACT | SM_OWN_KEYS, 0, 0, 0, 0 };
+  SM_OPTIONS compact_robin_hood = { SM_COMPACT | SM_OWN_KEYS | SM_ROBIN_HOOD | SM_POW2, 0, 0, 0, 0 };
+  SM_OPTIONS compact_incremental = { SM_COMPACT | SM_OWN_KEYS | SM_INCREMENTAL, sm_hash_wy, 25, 0, 0 };
+  SM_OPTIONS dirty = { SM_DIRTY_LOG, 0, 0, 0, 0 };
+  SM_OPTIONS dirty_swiss = { SM_DIRTY_LOG | SM_SWISS, 0, 0, 0, 0 };
+  SM_OPTIONS dirty_split = { SM_DIRTY_LOG | SM_SPLIT, 0, 0, 0, 0 };
+  SM_OPTIONS dirty_robin_hood_inline =
+      { SM_DIRTY_LOG | SM_ROBIN_HOOD | SM_INLINE_KEYS | SM_INCREMENTAL, 0, 0, 0, 0 };
+  SM_OPTIONS dirty_compact = { SM_DIRTY_LOG | SM_COMPACT | SM_OWN_KEYS, 0, 0, 0, 0 };
+  SM_OPTIONS inplace = { SM_INPLACE_GROW, 0, 0, 0, 0 };
+  SM_OPTIONS seqlock = { SM_SEQLOCK, 0, 0, 0, 0 };
+  SM_OPTIONS seqlock_own = { SM_SEQLOCK | SM_OWN_KEYS | SM_POW2, 0, 25, 0, 0 };
+  SM_OPTIONS inplace_pow2_inline = { SM_INPLACE_GROW | SM_POW2 | SM_INLINE_KEYS, sm_hash_wy, 25, 0, 0 };
+  SM_OPTIONS inplace_compact_dirty =
+      { SM_INPLACE_GROW | SM_COMPACT | SM_OWN_KEYS | SM_DIRTY_LOG, 0, 0, 0, 0 };
+  SM_OPTIONS values = { SM_INPLACE_GROW | SM_DIRTY_LOG, 0, 0, 0, sizeof (int) };
+  SM_OPTIONS keys_only = { SM_KEYS_ONLY | SM_OWN_KEYS | SM_INCREMENTAL, 0, 25, 0, 0 };
+  SM_OPTIONS huge_swiss = { SM_HUGE_PAGES | SM_SWISS | SM_INCREMENTAL, 0, 25, 0, 0 };
     
   GREATEST_MAIN_BEGIN();  
 
@@ -152,6 +1913,147 @@ int main(int argc, char **argv) {
   RUN_TEST(INSERT_1);
   RUN_TEST(UPSERT_1);  
   RUN_TEST(REMOVE_1);    
+  RUN_TEST(POLY_1);
+  RUN_TEST1(MODE_1, 0);
+  RUN_TEST1(MODE_1, &split);
+  RUN_TEST1(MODE_1, &swiss);
+  RUN_TEST1(MODE_1, &robin_hood);
+  RUN_TEST1(MODE_1, &pow2);
+  RUN_TEST1(MODE_1, &pow2_split);
+  RUN_TEST1(MODE_1, &pow2_robin_hood);
+  RUN_TEST1(MODE_1, &inline_keys);
+  RUN_TEST1(MODE_1, &pow2_robin_hood_inline);
+  RUN_TEST1(SHORT_1, &inline_keys);
+  RUN_TEST1(SHORT_1, &pow2_robin_hood_inline);
+  RUN_TEST1(SLICE_1, 0);
+  RUN_TEST1(SLICE_1, &split);
+  RUN_TEST1(SLICE_1, &swiss);
+  RUN_TEST1(SLICE_1, &inline_keys);
+  RUN_TEST1(SLICE_1, &pow2_robin_hood_inline);
+  RUN_TEST1(MODE_1, &wy);
+  RUN_TEST1(MODE_1, &crc32c);
+  RUN_TEST1(MODE_1, &swiss_wy);
+  RUN_TEST1(MODE_1, &pow2_crc32c);
+  RUN_TEST1(SLICE_1, &wy);
+  RUN_TEST1(HASH_1, &wy);
+  RUN_TEST1(HASH_1, &crc32c);
+  RUN_TEST1(SWISS_1, &swiss);
+  RUN_TEST1(SWISS_1, &dirty_swiss);
+  RUN_TEST1(POW2_1, &pow2);
+  RUN_TEST1(POW2_1, &pow2_split);
+  RUN_TEST1(POW2_1, &pow2_robin_hood);
+  RUN_TEST1(ROBIN_1, &robin_hood);
+  RUN_TEST1(ROBIN_1, &incremental_inline);
+  RUN_TEST1(PROBES_1, &robin_hood);
+  RUN_TEST1(PROBES_1, &pow2_robin_hood);
+  RUN_TEST1(PROBES_1, &pow2_robin_hood_inline);
+  RUN_TEST1(PROBES_1, &compact_robin_hood);
+  RUN_TEST1(MODE_1, &incremental);
+  RUN_TEST1(INCREMENTAL_1, &incremental);
+  RUN_TEST1(INCREMENTAL_1, &incremental_swiss);
+  RUN_TEST1(INCREMENTAL_1, &incremental_split);
+  RUN_TEST1(INCREMENTAL_1, &incremental_inline);
+  RUN_TEST1(SHORT_1, &incremental_inline);
+  RUN_TEST1(SHRINK_1, &robin_hood);
+  RUN_TEST1(SHRINK_1, &swiss);
+  RUN_TEST1(SHRINK_1, &incremental);
+  RUN_TEST1(SHRINK_1, &incremental_inline);
+  RUN_TEST1(OWN_1, &own_keys);
+  RUN_TEST1(OWN_1, &own_incremental);
+  RUN_TEST1(OWN_1, &own_inline);
+  RUN_TEST1(MODE_1, &own_keys);
+  RUN_TEST1(INCREMENTAL_1, &own_inline);
+  RUN_TEST1(SHRINK_1, &own_keys);
+  RUN_TEST1(ALLOC_1, &robin_hood);
+  RUN_TEST1(ALLOC_1, &swiss);
+  RUN_TEST1(ALLOC_1, &incremental_split);
+  RUN_TEST1(ALLOC_1, &own_incremental);
+  RUN_TEST1(ALLOC_1, &own_inline);
+  RUN_TEST1(MODE_1, &huge);
+  RUN_TEST1(HUGE_1, &huge);
+  RUN_TEST1(HUGE_1, &huge_swiss);
+  RUN_TEST1(ALLOC_1, &huge_swiss);
+  RUN_TEST1(MODE_1, &compact);
+  RUN_TEST1(MODE_1, &compact_robin_hood);
+  RUN_TEST1(SLICE_1, &compact);
+  RUN_TEST1(OWN_1, &compact);
+  RUN_TEST1(OWN_1, &compact_incremental);
+  RUN_TEST1(INCREMENTAL_1, &compact_incremental);
+  RUN_TEST1(SHRINK_1, &compact_robin_hood);
+  RUN_TEST1(ALLOC_1, &compact_incremental);
+  RUN_TEST1(COMPACT_1, &compact);
+  RUN_TEST1(COMPACT_1, &compact_robin_hood);
+  RUN_TEST1(CLEAR_1, 0);
+  RUN_TEST1(CLEAR_1, &dirty);
+  RUN_TEST1(CLEAR_1, &dirty_swiss);
+  RUN_TEST1(CLEAR_1, &dirty_split);
+  RUN_TEST1(CLEAR_1, &dirty_robin_hood_inline);
+  RUN_TEST1(CLEAR_1, &dirty_compact);
+  RUN_TEST1(MODE_1, &dirty_swiss);
+  RUN_TEST1(MODE_1, &inplace);
+  RUN_TEST1(MODE_1, &inplace_pow2_inline);
+  RUN_TEST1(MODE_1, &inplace_compact_dirty);
+  RUN_TEST1(GROW_1, &inplace);
+  RUN_TEST1(GROW_1, &inplace_pow2_inline);
+  RUN_TEST1(GROW_1, &inplace_compact_dirty);
+  RUN_TEST1(SHRINK_1, &inplace_pow2_inline);
+  RUN_TEST1(OWN_1, &inplace_compact_dirty);
+  RUN_TEST1(CLEAR_1, &inplace_compact_dirty);
+  RUN_TEST1(ALLOC_1, &inplace);
+  RUN_TEST1(ALLOC_1, &inplace_compact_dirty);
+  RUN_TEST1(MEMORY_1, &robin_hood);
+  RUN_TEST1(MEMORY_1, &swiss);
+  RUN_TEST1(MEMORY_1, &split);
+  RUN_TEST1(MEMORY_1, &own_incremental);
+  RUN_TEST1(MEMORY_1, &own_inline);
+  RUN_TEST1(MEMORY_1, &inplace_pow2_inline);
+  RUN_TEST1(MEMORY_1, &inplace_compact_dirty);
+  RUN_TEST1(VALUE_1, &pow2);
+  RUN_TEST1(VALUE_1, &robin_hood);
+  RUN_TEST1(VALUE_1, &swiss);
+  RUN_TEST1(VALUE_1, &pow2_split);
+  RUN_TEST1(VALUE_1, &pow2_robin_hood_inline);
+  RUN_TEST1(VALUE_1, &incremental_inline);
+  RUN_TEST1(VALUE_1, &own_incremental);
+  RUN_TEST1(VALUE_1, &compact_incremental);
+  RUN_TEST1(VALUE_1, &dirty_robin_hood_inline);
+  RUN_TEST1(VALUE_1, &inplace);
+  RUN_TEST1(VALUE_1, &inplace_compact_dirty);
+  RUN_TEST1(MEMORY_1, &values);
+  RUN_TEST1(SET_1, 0);
+  RUN_TEST1(SET_1, &pow2_robin_hood);
+  RUN_TEST1(SET_1, &incremental);
+  RUN_TEST1(SET_1, &own_keys);
+  RUN_TEST1(SET_1, &dirty);
+  RUN_TEST1(SET_1, &inplace);
+  RUN_TEST1(SHRINK_1, &keys_only);
+  RUN_TEST1(MEMORY_1, &keys_only);
+  RUN_TEST1(SHARD_1, 0);
+  RUN_TEST1(SHARD_1, &robin_hood);
+  RUN_TEST1(SHARD_1, &own_incremental);
+  RUN_TEST1(SHARD_1, &inplace_compact_dirty);
+  RUN_TEST1(RCU_1, 0);
+  RUN_TEST1(RCU_1, &robin_hood);
+  RUN_TEST1(RCU_1, &own_incremental);
+  RUN_TEST1(RCU_1, &own_inline);
+  RUN_TEST1(RCU_1, &inplace_compact_dirty);
+  RUN_TEST1(MODE_1, &seqlock);
+  RUN_TEST1(MODE_1, &seqlock_own);
+  RUN_TEST1(SHRINK_1, &seqlock_own);
+  RUN_TEST1(CLEAR_1, &seqlock_own);
+  RUN_TEST1(ALLOC_1, &seqlock_own);
+  RUN_TEST1(MEMORY_1, &seqlock_own);
+  RUN_TEST1(SEQ_1, &seqlock);
+  RUN_TEST1(SEQ_1, &seqlock_own);
+  RUN_TEST1(LF_1, 0);
+  RUN_TEST1(LF_1, &wy);
+  RUN_TEST1(BUILD_1, 0);
+  RUN_TEST1(BUILD_1, &pow2_split);
+  RUN_TEST1(BUILD_1, &inline_keys);
+  RUN_TEST1(BUILD_1, &keys_only);
+  RUN_TEST1(BUILD_1, &own_inline);
+  RUN_TEST1(BUILD_1, &swiss);
+  RUN_TEST1(BUILD_1, &seqlock);
   
   free(keys);
   free(xkeys);
@@ -0,0 +1,238 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "greatest.h"
+#include "strmap.h"
+#include "strmap_int.h"
+#include "strmap.hpp"
+
+unsigned long MAP_SIZE = 1024;
+
+/* keys to insert */
+std::vector<char *> keys;
+
+/* sm_foreach callback, keys in slot order */
+void collect(SM_ENTRY item, void *ctx) {
+  ((std::vector<const char *> *)ctx)->push_back(item.key);
+}
+
+/* for_each action, keys in slot order */
+struct collector {
+  std::vector<const char *> *keys;
+
+  template <class Entry>
+  void operator() (const Entry & e) const {
+    keys->push_back(e.key);
+  }
+};
+
+/* C map slots, SM_ENTRY table, SM_ROBIN_HOOD: a distance byte each */
+size_t c_capacity(const STRMAP *sm, unsigned int flags) {
+  SM_MEMORY m;
+
+  sm_memory_usage(sm, &m);
+  return m.table / (sizeof (SM_ENTRY) + (flags & SM_ROBIN_HOOD ? 1 : 0));
+}
+
+/* C map with `flags` and C++ map with `Layout` place keys in the same
+   slots of tables of the same capacity, before and after growth */
+template <class Layout>
+bool same_slots(unsigned int flags, size_t reserve) {
+  SM_OPTIONS opts = {0, 0, 0, 0, 0};
+  sm::basic_strmap<int, sm::poly_hash, Layout> cpp(reserve);
+  std::vector<const char *> a, b;
+  collector c;
+  STRMAP *sm;
+  unsigned long i;
+  bool same = true;
+
+  opts.flags = flags;
+  if (!(sm = sm_create_ex(reserve, &opts))) {
+    return false;
+  }
+  c.keys = &b;
+  for (i = 0; same && i < MAP_SIZE; ++i) {
+    sm_insert(sm, keys[i], 0, 0);
+    cpp.insert(keys[i], 0);
+    if (!(i & (i + 1)) || i + 1 == MAP_SIZE) {
+      a.clear();
+      b.clear();
+      sm_foreach(sm, collect, &a);
+      cpp.for_each(c);
+      same = (c_capacity(sm, flags) == cpp.capacity() && a == b);
+    }
+  }
+
+  sm_free(sm);
+  return same;
+}
+
+/* value whose copies throw once `countdown` reaches zero, moves never */
+struct fragile {
+  static long countdown;        /* -1 - never throw */
+  unsigned long n;
+
+  fragile() : n(0) {
+  }
+  fragile(unsigned long v) : n(v) {
+  }
+  fragile(const fragile & f) : n(f.n) {
+    tick();
+  }
+  fragile(fragile && f) noexcept : n(f.n) {
+  }
+  fragile & operator=(const fragile & f) {
+    tick();
+    n = f.n;
+    return *this;
+  }
+  fragile & operator=(fragile && f) noexcept {
+    n = f.n;
+    return *this;
+  }
+  static void tick() {
+    if (countdown >= 0 && countdown-- == 0) {
+      throw std::bad_alloc();
+    }
+  }
+};
+
+long fragile::countdown = -1;
+
+/* insert and reserve that throw, in growth or in the value copy, leave
+   the map as it was */
+template <class Layout>
+bool strong_insert() {
+  sm::basic_strmap<fragile, sm::poly_hash, Layout> map;
+  unsigned long i, j, n = 0;
+  size_t capacity;
+  bool thrown;
+
+  for (i = 0; i < MAP_SIZE; ++i) {
+    capacity = map.capacity();
+    fragile::countdown = (long)(i % 5);
+    thrown = false;
+    try {
+      map.insert(keys[i], fragile(i));
+      if (i % 7 == 0) {
+        map.reserve(2 * map.capacity());
+      }
+    }
+    catch (const std::bad_alloc &) {
+      thrown = true;
+    }
+    fragile::countdown = -1;
+    if (thrown && map.find(keys[i]) && map.size() == n + 1) {
+      /* reserve threw after the insert */
+      ++n;
+      continue;
+    }
+    if (thrown && (map.find(keys[i]) || map.size() != n
+                   || map.capacity() != capacity)) {
+      return false;
+    }
+    n += !thrown;
+  }
+  for (i = 0, j = 0; i < MAP_SIZE; ++i) {
+    if (map.find(keys[i])) {
+      if (map.find(keys[i])->n != i) {
+        return false;
+      }
+      ++j;
+    }
+  }
+  return j == n && map.size() == n;
+}
+
+TEST
+STRONG_1() {
+  ASSERT(strong_insert<sm::linear>());
+  ASSERT(strong_insert<sm::pow2>());
+  ASSERT(strong_insert<sm::robin_hood>());
+
+  PASS();
+}
+
+TEST
+DIMENSION_1(unsigned int flags) {
+  SM_OPTIONS opts = {0, 0, 0, 0, 0};
+  size_t size, msize, capacity;
+  STRMAP *sm;
+
+  opts.flags = flags;
+  for (size = 0; size < MAP_SIZE; size += size / 8 + 1) {
+    ASSERT(sm_dimension(flags, size, &msize, &capacity));
+    ASSERT(msize >= size);
+    ASSERT(msize < capacity);
+    if (flags & SM_POW2) {
+      ASSERT(!(capacity & (capacity - 1)));
+      ASSERT_EQ((sm::basic_strmap<int, sm::poly_hash, sm::pow2>(size)
+                 .capacity()), capacity);
+    }
+    else {
+      ASSERT(capacity % 2 && capacity % 3 && capacity % 5);
+      ASSERT_EQ(sm::strmap<int>(size).capacity(), capacity);
+    }
+    ASSERT(sm = sm_create_ex(size, &opts));
+    ASSERT_EQ(c_capacity(sm, flags), capacity);
+    sm_free(sm);
+  }
+
+  PASS();
+}
+
+TEST
+POSITION_1() {
+  size_t hash, h;
+
+  for (hash = 1; hash; hash <<= 1) {
+    h = hash;
+    SM_MIX(h);
+    ASSERT_EQ(sm::pow2::position(hash, 1024), h & 1023);
+    ASSERT_EQ(sm::linear::position(hash, 1021), hash % 1021);
+  }
+
+  PASS();
+}
+
+TEST
+SLOTS_1() {
+  ASSERT(same_slots<sm::linear>(SM_DEFAULT, 0));
+  ASSERT(same_slots<sm::linear>(SM_DEFAULT, MAP_SIZE));
+  ASSERT(same_slots<sm::pow2>(SM_POW2, 0));
+  ASSERT(same_slots<sm::pow2>(SM_POW2, MAP_SIZE));
+  ASSERT(same_slots<sm::robin_hood>(SM_ROBIN_HOOD, 0));
+
+  PASS();
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  unsigned long i;
+
+  GREATEST_MAIN_BEGIN();
+
+  if (argc > 1) {
+    MAP_SIZE = std::strtoul(argv[1], 0, 10);
+  }
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    keys.push_back(new char[24]);
+    std::sprintf(keys[i], "%lu", i * 2654435761UL);
+  }
+
+  RUN_TEST1(DIMENSION_1, SM_DEFAULT);
+  RUN_TEST1(DIMENSION_1, SM_POW2);
+  RUN_TEST(POSITION_1);
+  RUN_TEST(SLOTS_1);
+  RUN_TEST(STRONG_1);
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    delete[] keys[i];
+  }
+
+  GREATEST_MAIN_END();
+}